@@ -30,7 +30,38 @@
 #include "files.mdh"
 
 typedef int (*MoveFunc) _((char const *, char const *));
-typedef int (*RecurseFunc) _((char *, char *, struct stat const *, void *));
+typedef int (*RecurseFunc) _((char *, int, char *, struct stat const *, void *));
+
+/*
+ * Where the system allows, recursive commands work on each file
+ * relative to a descriptor for its directory instead of changing into
+ * every directory and back out again.  Otherwise the descriptor
+ * passed around is always REC_CWD, and file names are relative to the
+ * current directory.
+ */
+
+#if defined(HAVE_OPENAT) && defined(HAVE_FDOPENDIR) && \
+    defined(HAVE_FSTATAT) && defined(HAVE_UNLINKAT) && \
+    defined(HAVE_FCHOWNAT) && defined(HAVE_FACCESSAT) && \
+    defined(AT_FDCWD) && defined(AT_REMOVEDIR) && \
+    defined(AT_SYMLINK_NOFOLLOW) && defined(O_DIRECTORY) && defined(O_NOFOLLOW)
+# define RECURSE_AT
+# define REC_CWD AT_FDCWD
+# define rec_lstat(D, P, S) fstatat(D, P, S, AT_SYMLINK_NOFOLLOW)
+# define rec_access(D, P, M) faccessat(D, P, M, 0)
+# define rec_unlink(D, P) unlinkat(D, P, 0)
+# define rec_rmdir(D, P) unlinkat(D, P, AT_REMOVEDIR)
+# define rec_chown(D, P, U, G) fchownat(D, P, U, G, 0)
+# define rec_lchown(D, P, U, G) fchownat(D, P, U, G, AT_SYMLINK_NOFOLLOW)
+#else
+# define REC_CWD (-1)
+# define rec_lstat(D, P, S) lstat(P, S)
+# define rec_access(D, P, M) access(P, M)
+# define rec_unlink(D, P) unlink(P)
+# define rec_rmdir(D, P) rmdir(P)
+# define rec_chown(D, P, U, G) chown(P, U, G)
+# define rec_lchown(D, P, U, G) lchown(P, U, G)
+#endif
 
 #ifndef STDC_HEADERS
 extern int link _((const char *, const char *));
@@ -42,6 +73,17 @@ struct recursivecmd;
 
 #include "files.pro"
 
+#ifdef HAVE_SYS_SENDFILE_H
+# include <sys/sendfile.h>
+#endif
+#ifdef HAVE_LINUX_FS_H
+# include <sys/ioctl.h>
+# include <linux/fs.h>
+#endif
+#ifndef HAVE_UTIMENSAT
+# include <utime.h>
+#endif
+
 /**/
 static int
 ask(void)
@@ -161,10 +203,11 @@ bin_rmdir(char *nam, char **args, UNUSED(Options ops), UNUSED(int func))
     return err;
 }
 
-/* ln and mv builtins */
+/* ln, mv and cp builtins */
 
 #define BIN_LN 0
 #define BIN_MV 1
+#define BIN_CP 2
 
 #define MV_NODIRS		(1<<0)
 #define MV_FORCE		(1<<1)
@@ -172,12 +215,31 @@ bin_rmdir(char *nam, char **args, UNUSED(Options ops), UNUSED(int func))
 #define MV_ASKNW		(1<<3)
 #define MV_ATOMIC		(1<<4)
 #define MV_NOCHASETARGET	(1<<5)
+#define MV_COPY			(1<<6)
+#define MV_MERGEDIRS		(1<<7)
+
+#define CP_RECURSE	(1<<0)	/* copy directories and what's in them */
+#define CP_PRESERVE	(1<<1)	/* keep owners, modes and times */
+#define CP_FORCE	(1<<2)	/* replace files that can't be opened */
+#define CP_INTERACTIVE	(1<<3)	/* ask before replacing a file */
+#define CP_ASKNW	(1<<4)	/* ask before replacing an unwritable file */
+
+/* How cp, or mv between file systems, is to copy */
+
+static struct copyinfo {
+    char *nam;
+    int flags;
+    int havetop;		/* dev and ino are set */
+    dev_t dev;			/* the first directory created, which */
+    ino_t ino;			/* mustn't be copied into itself */
+} copyinfo;
 
 /*
- * bin_ln actually does three related jobs: hard linking, symbolic
- * linking, and renaming.  If called as mv it renames, otherwise
- * it looks at the -s option.  If hard linking, it will refuse to
- * attempt linking to a directory unless the -d option is given.
+ * bin_ln actually does four related jobs: hard linking, symbolic
+ * linking, renaming and copying.  If called as mv it renames, as cp
+ * it copies, otherwise it looks at the -s option.  If hard linking,
+ * it will refuse to attempt linking to a directory unless the -d
+ * option is given.
  */
 
 /*
@@ -202,10 +264,24 @@ bin_ln(char *nam, char **args, Options ops, int func)
     size_t blen;
 
 
+    copyinfo.nam = nam;
     if(func == BIN_MV) {
-	movefn = (MoveFunc) rename;
+	movefn = mvfile;
 	flags = OPT_ISSET(ops,'f') ? 0 : MV_ASKNW;
 	flags |= MV_ATOMIC;
+    } else if(func == BIN_CP) {
+	movefn = cpfile;
+	flags = OPT_ISSET(ops,'f') ? 0 : MV_ASKNW;
+	flags |= MV_COPY;
+	copyinfo.flags = 0;
+	if(OPT_ISSET(ops,'R') || OPT_ISSET(ops,'r')) {
+	    copyinfo.flags |= CP_RECURSE;
+	    flags |= MV_MERGEDIRS;
+	}
+	if(OPT_ISSET(ops,'p'))
+	    copyinfo.flags |= CP_PRESERVE;
+	if(OPT_ISSET(ops,'f'))
+	    copyinfo.flags |= CP_FORCE;
     } else {
 	flags = OPT_ISSET(ops,'f') ? MV_FORCE : 0;
 #ifdef HAVE_LSTAT
@@ -223,6 +299,13 @@ bin_ln(char *nam, char **args, Options ops, int func)
     }
     if(OPT_ISSET(ops,'i') && !OPT_ISSET(ops,'f'))
 	flags |= MV_INTERACTIVE;
+    /* cp -R asks the same about files it finds in directories */
+    if(func == BIN_CP) {
+	if(flags & MV_INTERACTIVE)
+	    copyinfo.flags |= CP_INTERACTIVE;
+	else if(flags & MV_ASKNW)
+	    copyinfo.flags |= CP_ASKNW;
+    }
     for(a = args; a[1]; a++) ;
     if(a != args) {
 	rp = unmeta(*a);
@@ -289,12 +372,34 @@ bin_ln(char *nam, char **args, Options ops, int func)
     return err;
 }
 
+/*
+ * Ask whether to replace the file q, saying what its mode is if
+ * it's because the file can't be written.
+ */
+
+/**/
+static int
+askreplace(char *nam, char *q, struct stat const *sp, int nw)
+{
+    nicezputs(nam, stderr);
+    fputs(": replace `", stderr);
+    nicezputs(q, stderr);
+    if(nw)
+	fprintf(stderr, "', overriding mode %04o? ",
+	    mode_to_octal(sp->st_mode));
+    else
+	fputs("'? ", stderr);
+    fflush(stderr);
+    return ask();
+}
+
 /**/
 static int
 domove(char *nam, MoveFunc movefn, char *p, char *q, int flags)
 {
-    struct stat st;
+    struct stat st, st2;
     char *pbuf, *qbuf;
+    int ret;
 
     pbuf = ztrdup(unmeta(p));
     qbuf = unmeta(q);
@@ -306,19 +411,24 @@ domove(char *nam, MoveFunc movefn, char *p, char *q, int flags)
 	    return 1;
 	}
     }
+    if((flags & MV_COPY) && !stat(pbuf, &st) && !stat(qbuf, &st2) &&
+       st.st_dev == st2.st_dev && st.st_ino == st2.st_ino) {
+	zwarnnam(nam, "%s and %s are the same file", p, q);
+	zsfree(pbuf);
+	return 1;
+    }
     if(!lstat(qbuf, &st)) {
 	int doit = flags & MV_FORCE;
 	if(S_ISDIR(st.st_mode)) {
-	    zwarnnam(nam, "%s: cannot overwrite directory", q);
-	    zsfree(pbuf);
-	    return 1;
+	    /* cp -R copies the contents of one directory into another */
+	    if(!(flags & MV_MERGEDIRS) ||
+	       lstat(pbuf, &st2) || !S_ISDIR(st2.st_mode)) {
+		zwarnnam(nam, "%s: cannot overwrite directory", q);
+		zsfree(pbuf);
+		return 1;
+	    }
 	} else if(flags & MV_INTERACTIVE) {
-	    nicezputs(nam, stderr);
-	    fputs(": replace `", stderr);
-	    nicezputs(q, stderr);
-	    fputs("'? ", stderr);
-	    fflush(stderr);
-	    if(!ask()) {
+	    if(!askreplace(nam, q, &st, 0)) {
 		zsfree(pbuf);
 		return 0;
 	    }
@@ -326,13 +436,7 @@ domove(char *nam, MoveFunc movefn, char *p, char *q, int flags)
 	} else if((flags & MV_ASKNW) &&
 		!S_ISLNK(st.st_mode) &&
 		access(qbuf, W_OK)) {
-	    nicezputs(nam, stderr);
-	    fputs(": replace `", stderr);
-	    nicezputs(q, stderr);
-	    fprintf(stderr, "', overriding mode %04o? ",
-		mode_to_octal(st.st_mode));
-	    fflush(stderr);
-	    if(!ask()) {
+	    if(!askreplace(nam, q, &st, 1)) {
 		zsfree(pbuf);
 		return 0;
 	    }
@@ -341,8 +445,10 @@ domove(char *nam, MoveFunc movefn, char *p, char *q, int flags)
 	if(doit && !(flags & MV_ATOMIC))
 	    unlink(qbuf);
     }
-    if(movefn(pbuf, qbuf)) {
-	zwarnnam(nam, "%s: %e", p, errno);
+    /* A positive status means the error has been reported already */
+    if((ret = movefn(pbuf, qbuf))) {
+	if(ret < 0)
+	    zwarnnam(nam, "%s: %e", p, errno);
 	zsfree(pbuf);
 	return 1;
     }
@@ -350,8 +456,425 @@ domove(char *nam, MoveFunc movefn, char *p, char *q, int flags)
     return 0;
 }
 
+/*
+ * Copying, for cp and for mv between file systems.  The functions
+ * below take unmetafied names and, like rename(), return -1 with errno
+ * set if the file given couldn't be copied.  Problems with files
+ * further down a directory are reported as they happen, and the
+ * return status is then 1.
+ */
+
+/* The size of buffer for copying, and of a chunk copied by the system */
+
+#define COPYBUFSIZ 65536
+#define COPYCHUNK (1 << 30)
+
+/* Errors meaning the system can't copy between the files for us. */
+
+#define COPY_UNSUPPORTED(E) ((E) == EXDEV || (E) == ENOSYS || \
+			     (E) == EINVAL || (E) == EOPNOTSUPP)
+
+/* A name for messages. */
+
+/**/
+static char *
+copyname(char const *p)
+{
+    return metafy((char *) p, -1, META_HEAPDUP);
+}
+
+/*
+ * Copy the contents of one open file to another.  Where the file
+ * system can, the copy shares the original's blocks; otherwise, the
+ * system copies the data itself if it can, and only as a last resort
+ * do we read and write it.
+ */
+
+/**/
+static int
+copydata(int in, int out, off_t size)
+{
+    char *buf, *ptr;
+    ssize_t n, w;
+#if defined(HAVE_COPY_FILE_RANGE) || \
+    (defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H))
+    off_t done;
+#endif
+    int ret = 0;
+
+    /*
+     * Files reporting no size, such as many under /proc, may still
+     * have contents that only read() finds.
+     */
+    if (size > 0) {
+#ifdef FICLONE
+	if (!ioctl(out, FICLONE, in))
+	    return 0;
+#endif
+#ifdef HAVE_COPY_FILE_RANGE
+	for (done = 0;;) {
+	    if ((n = copy_file_range(in, NULL, out, NULL, COPYCHUNK, 0)) > 0)
+		done += n;
+	    else if (!n) {
+		if (done)
+		    return 0;
+		break;
+	    } else if (errno == EINTR && !errflag)
+		continue;
+	    else if (done || !COPY_UNSUPPORTED(errno))
+		return -1;
+	    else
+		break;
+	}
+#endif
+#if defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H)
+	for (done = 0;;) {
+	    if ((n = sendfile(out, in, NULL, COPYCHUNK)) > 0)
+		done += n;
+	    else if (!n) {
+		if (done)
+		    return 0;
+		break;
+	    } else if (errno == EINTR && !errflag)
+		continue;
+	    else if (done || !COPY_UNSUPPORTED(errno))
+		return -1;
+	    else
+		break;
+	}
+#endif
+    }
+
+    buf = (char *) zalloc(COPYBUFSIZ);
+    while (!ret && (n = read(in, buf, COPYBUFSIZ))) {
+	if (n < 0) {
+	    if (errno != EINTR || errflag)
+		ret = -1;
+	    continue;
+	}
+	for (ptr = buf; n > 0; ptr += w, n -= w) {
+	    if ((w = write(out, ptr, n)) < 0) {
+		if (errno == EINTR && !errflag) {
+		    w = 0;
+		    continue;
+		}
+		ret = -1;
+		break;
+	    }
+	}
+    }
+    zfree(buf, COPYBUFSIZ);
+    return ret;
+}
+
+/* Give a copy the owner, mode and times of the original. */
+
+/**/
+static int
+copyattrs(char const *q, struct stat const *sp)
+{
+#ifdef HAVE_UTIMENSAT
+    struct timespec ts[2];
+#else
+    struct utimbuf ub;
+#endif
+
+    /* Only the superuser can give files away; failing that, try the group */
+    if (lchown(q, sp->st_uid, sp->st_gid) &&
+	lchown(q, (uid_t)-1, sp->st_gid) && errno != EPERM)
+	return -1;
+    if (S_ISLNK(sp->st_mode)) {
+#if defined(HAVE_UTIMENSAT) && defined(AT_SYMLINK_NOFOLLOW)
+	ts[0].tv_sec = sp->st_atime;
+	ts[1].tv_sec = sp->st_mtime;
+	ts[0].tv_nsec = ts[1].tv_nsec = 0;
+	/* Not every system can set the times of a link */
+	utimensat(AT_FDCWD, q, ts, AT_SYMLINK_NOFOLLOW);
+#endif
+	return 0;
+    }
+    if (chmod(q, sp->st_mode & 07777))
+	return -1;
+#ifdef HAVE_UTIMENSAT
+    ts[0].tv_sec = sp->st_atime;
+    ts[1].tv_sec = sp->st_mtime;
+# ifdef GET_ST_ATIME_NSEC
+    ts[0].tv_nsec = GET_ST_ATIME_NSEC(*sp);
+# else
+    ts[0].tv_nsec = 0;
+# endif
+# ifdef GET_ST_MTIME_NSEC
+    ts[1].tv_nsec = GET_ST_MTIME_NSEC(*sp);
+# else
+    ts[1].tv_nsec = 0;
+# endif
+    return utimensat(AT_FDCWD, q, ts, 0);
+#else
+    ub.actime = sp->st_atime;
+    ub.modtime = sp->st_mtime;
+    return utime(q, &ub);
+#endif
+}
+
+/**/
+static int
+copyreg(char const *p, char const *q, struct stat const *sp)
+{
+    int in, out, ret = 0, e;
+
+    if ((in = open(p, O_RDONLY | O_NOCTTY)) < 0)
+	return -1;
+    out = open(q, O_WRONLY | O_CREAT | O_TRUNC | O_NOCTTY,
+	       sp->st_mode & 0777);
+    if (out < 0 && errno != ENOENT && (copyinfo.flags & CP_FORCE) &&
+	!unlink(q))
+	out = open(q, O_WRONLY | O_CREAT | O_EXCL | O_NOCTTY,
+		   sp->st_mode & 0777);
+    if (out < 0) {
+	e = errno;
+	close(in);
+	errno = e;
+	return -1;
+    }
+    if (copydata(in, out, sp->st_size))
+	ret = -1;
+    e = errno;
+    close(in);
+    if (close(out) && !ret) {
+	e = errno;
+	ret = -1;
+    }
+    errno = e;
+    return ret;
+}
+
+/**/
+static int
+copylink(char const *p, char const *q, struct stat const *sp)
+{
+    char *buf = zhalloc(sp->st_size + 1);
+    ssize_t len;
+
+    if ((len = readlink(p, buf, sp->st_size + 1)) < 0)
+	return -1;
+    if (len > sp->st_size) {
+	/* it changed under us */
+	errno = ENAMETOOLONG;
+	return -1;
+    }
+    buf[len] = '\0';
+    if (symlink(buf, q) && (errno != EEXIST || unlink(q) || symlink(buf, q)))
+	return -1;
+    return 0;
+}
+
+/**/
+static int
+copydir(char const *p, char const *q, struct stat const *sp)
+{
+    struct stat st;
+    DIR *d;
+    char *fn, *files = NULL;
+    int fileslen = 0, made, err = 0, plen, qlen;
+
+    if (copyinfo.havetop && sp->st_dev == copyinfo.dev &&
+	sp->st_ino == copyinfo.ino) {
+	zwarnnam(copyinfo.nam, "%s: cannot copy a directory into itself",
+		 copyname(p));
+	return 1;
+    }
+    /* Keep the directory writable until it's filled in */
+    if (!(made = !mkdir(q, (sp->st_mode & 0777) | S_IRWXU))) {
+	int e = errno;
+
+	if (e != EEXIST || stat(q, &st) || !S_ISDIR(st.st_mode)) {
+	    errno = e;
+	    return -1;
+	}
+    }
+    if (!copyinfo.havetop && !stat(q, &st)) {
+	copyinfo.havetop = 1;
+	copyinfo.dev = st.st_dev;
+	copyinfo.ino = st.st_ino;
+    }
+    if (!(d = opendir(p)))
+	return -1;
+    while (!errflag && (fn = zreaddir(d, 1))) {
+	int l = strlen(fn) + 1;
+	files = hrealloc(files, fileslen, fileslen + l);
+	strcpy(files + fileslen, fn);
+	fileslen += l;
+    }
+    closedir(d);
+    plen = strlen(p);
+    qlen = strlen(q);
+    for (fn = files; !errflag && fn < files + fileslen;) {
+	int l = strlen(fn) + 1, ret;
+	VARARR(char, np, plen + l + 1);
+	VARARR(char, nq, qlen + l + 1);
+
+	unmetafy(fn, NULL);
+	sprintf(np, "%s/%s", p, fn);
+	sprintf(nq, "%s/%s", q, fn);
+	fn += l;
+	/* As domove() asks about the file named to cp */
+	if ((copyinfo.flags & (CP_INTERACTIVE|CP_ASKNW)) &&
+	    !lstat(nq, &st) && !S_ISDIR(st.st_mode) &&
+	    ((copyinfo.flags & CP_INTERACTIVE) ||
+	     (!S_ISLNK(st.st_mode) && access(nq, W_OK)))) {
+	    if (!askreplace(copyinfo.nam, copyname(nq), &st,
+			    !(copyinfo.flags & CP_INTERACTIVE)))
+		continue;
+	    if (unlink(nq)) {
+		zwarnnam(copyinfo.nam, "%s: %e", copyname(nq), errno);
+		err = 1;
+		continue;
+	    }
+	}
+	if ((ret = copytree(np, nq)) < 0)
+	    zwarnnam(copyinfo.nam, "%s: %e", copyname(np), errno);
+	if (ret)
+	    err = 1;
+    }
+    hrealloc(files, fileslen, 0);
+    if (errflag)
+	return 1;
+
+    if (copyinfo.flags & CP_PRESERVE) {
+	if (copyattrs(q, sp))
+	    return -1;
+    } else if (made && (sp->st_mode & S_IRWXU) != S_IRWXU) {
+	mode_t mask = umask(0);
+
+	umask(mask);
+	if (chmod(q, sp->st_mode & 0777 & ~mask))
+	    return -1;
+    }
+    return err;
+}
+
+/**/
+static int
+copytree(char const *p, char const *q)
+{
+    struct stat st;
+    int ret;
+
+    if ((copyinfo.flags & CP_RECURSE) ? lstat(p, &st) : stat(p, &st))
+	return -1;
+    if (S_ISDIR(st.st_mode)) {
+	if (!(copyinfo.flags & CP_RECURSE)) {
+	    errno = EISDIR;
+	    return -1;
+	}
+	return copydir(p, q, &st);
+    }
+    /*
+     * Only a tree is copied as it is; otherwise whatever can be read,
+     * such as a pipe or a device, is copied as a file.
+     */
+    if (S_ISREG(st.st_mode) || !(copyinfo.flags & CP_RECURSE))
+	ret = copyreg(p, q, &st);
+    else if (S_ISLNK(st.st_mode))
+	ret = copylink(p, q, &st);
+#ifdef HAVE_MKFIFO
+    else if (S_ISFIFO(st.st_mode))
+	ret = (mkfifo(q, st.st_mode & 0777) &&
+	       (errno != EEXIST || unlink(q) ||
+		mkfifo(q, st.st_mode & 0777))) ? -1 : 0;
+#endif
+    else {
+	zwarnnam(copyinfo.nam, "%s: cannot copy special file", copyname(p));
+	return 1;
+    }
+    if (!ret && (copyinfo.flags & CP_PRESERVE))
+	ret = copyattrs(q, &st);
+    return ret;
+}
+
+/**/
+static int
+cpfile(char const *p, char const *q)
+{
+    copyinfo.havetop = 0;
+    return copytree(p, q);
+}
+
+/*
+ * mv renames where it can, and otherwise copies everything and
+ * removes the original once all of it has been copied, so that a
+ * failure part way through leaves the original whole.
+ */
+
+/**/
+static int
+mvfile(char const *p, char const *q)
+{
+    struct stat st;
+    char *args[2];
+    int ret;
+
+    if (!rename(p, q))
+	return 0;
+    if (errno != EXDEV)
+	return -1;
+    /* rename() would replace the target rather than write over it */
+    if (!lstat(q, &st) && !S_ISDIR(st.st_mode) && unlink(q))
+	return -1;
+    copyinfo.flags = CP_RECURSE | CP_PRESERVE;
+    copyinfo.havetop = 0;
+    if ((ret = copytree(p, q)))
+	return ret;
+    args[0] = copyname(p);
+    args[1] = NULL;
+    return recursivecmd(copyinfo.nam, 0, 1, 0, args, recurse_donothing,
+			mv_rmdir, mv_unlink, NULL);
+}
+
+/* Remove what mv has copied to another file system. */
+
+/**/
+static int
+mv_unlink(char *arg, int dfd, char *rp, UNUSED(struct stat const *sp),
+    UNUSED(void *magic))
+{
+    if (rec_unlink(dfd, rp)) {
+	zwarnnam(copyinfo.nam, "%s: %e", arg, errno);
+	return 1;
+    }
+    return 0;
+}
+
+/**/
+static int
+mv_rmdir(char *arg, int dfd, char *rp, UNUSED(struct stat const *sp),
+    UNUSED(void *magic))
+{
+    if (rec_rmdir(dfd, rp)) {
+	zwarnnam(copyinfo.nam, "%s: %e", arg, errno);
+	return 1;
+    }
+    return 0;
+}
+
 /* general recursion */
 
+#ifdef RECURSE_AT
+/*
+ * A directory being walked, which holds a descriptor while the walk
+ * is below it.  A deep enough tree runs out of descriptors; then those
+ * for the directories furthest up are closed, and each is opened again
+ * through ".." from the one below when the walk gets back to it.
+ */
+
+struct recdir {
+    int fd;			/* -1 if closed to save descriptors */
+    DIR *dir;			/* the directory read, if still open */
+    dev_t dev;
+    ino_t ino;
+};
+#endif
+
 struct recursivecmd {
     char *nam;
     int opt_noerr;
@@ -361,6 +884,11 @@ struct recursivecmd {
     RecurseFunc dirpost_func;
     RecurseFunc leaf_func;
     void *magic;
+#ifdef RECURSE_AT
+    struct recdir *dirs;	/* the directories being walked, top first */
+    int ndirs;			/* the space allocated for them */
+    int depth;			/* the number being walked */
+#endif
 };
 
 /**/
@@ -382,6 +910,10 @@ recursivecmd(char *nam, int opt_noerr, int opt_recurse, int opt_safe,
     reccmd.dirpost_func = dirpost_func;
     reccmd.leaf_func = leaf_func;
     reccmd.magic = magic;
+#ifdef RECURSE_AT
+    reccmd.dirs = NULL;
+    reccmd.ndirs = reccmd.depth = 0;
+#endif
     init_dirsav(&ds);
     if (opt_recurse || opt_safe) {
 	if ((ds.dirfd = open(".", O_RDONLY|O_NOCTTY)) < 0 &&
@@ -411,16 +943,17 @@ recursivecmd(char *nam, int opt_noerr, int opt_recurse, int opt_safe,
 		    d.ino = d.dev = 0;
 		    d.dirname = NULL;
 		    d.dirfd = d.level = -1;
-		    err |= recursivecmd_doone(&reccmd, *args, s + 1, &d, 0);
+		    err |= recursivecmd_doone(&reccmd, *args, REC_CWD, s + 1,
+					      &d, 0);
 		    zsfree(d.dirname);
 		    if (restoredir(&ds))
 			err |= 2;
 		} else if(!opt_noerr)
 		    zwarnnam(nam, "%s: %e", *args, errno);
 	    } else
-		err |= recursivecmd_doone(&reccmd, *args, rp, &ds, 0);
+		err |= recursivecmd_doone(&reccmd, *args, REC_CWD, rp, &ds, 0);
 	} else
-	    err |= recursivecmd_doone(&reccmd, *args, rp, &ds, 1);
+	    err |= recursivecmd_doone(&reccmd, *args, REC_CWD, rp, &ds, 1);
 	zfree(rp, len + 1);
     }
     if ((err & 2) && ds.dirfd >= 0 && restoredir(&ds) && zchdir(pwd)) {
@@ -432,40 +965,164 @@ recursivecmd(char *nam, int opt_noerr, int opt_recurse, int opt_safe,
     if (ds.dirfd >= 0)
 	close(ds.dirfd);
     zsfree(ds.dirname);
+#ifdef RECURSE_AT
+    if (reccmd.dirs)
+	zfree(reccmd.dirs, reccmd.ndirs * sizeof(struct recdir));
+#endif
     return !!err;
 }
 
+#ifdef RECURSE_AT
+/*
+ * Close the descriptor of the open directory furthest up, apart from
+ * the one the walk is in.  Returns -1 if there is none.
+ */
+
+/**/
+static int
+recursivecmd_closeup(struct recursivecmd *reccmd)
+{
+    int i;
+
+    for (i = 0; i < reccmd->depth - 1; i++) {
+	struct recdir *rd = reccmd->dirs + i;
+
+	if (rd->fd >= 0) {
+	    if (rd->dir)
+		closedir(rd->dir);
+	    else
+		close(rd->fd);
+	    rd->fd = -1;
+	    rd->dir = NULL;
+	    return 0;
+	}
+    }
+    return -1;
+}
+
+/*
+ * Open a directory relative to another, closing directories further up
+ * if there are no descriptors left.
+ */
+
+/**/
+static int
+recursivecmd_openat(struct recursivecmd *reccmd, int dfd, char *rp, int flags)
+{
+    int fd;
+
+    while ((fd = openat(dfd, rp, O_RDONLY | O_NOCTTY | O_DIRECTORY | flags)) < 0
+	   && (errno == EMFILE || errno == ENFILE) &&
+	   !recursivecmd_closeup(reccmd))
+	;
+    return fd;
+}
+
+/*
+ * Return the descriptor for the directory containing the one being
+ * walked, which is at the given level, opening it again through ".."
+ * if it was closed.  Returns -1 if it isn't the same directory.
+ */
+
 /**/
 static int
-recursivecmd_doone(struct recursivecmd const *reccmd,
-    char *arg, char *rp, struct dirsav *ds, int first)
+recursivecmd_parent(struct recursivecmd *reccmd, int level)
+{
+    struct recdir *rd = reccmd->dirs + level - 1;
+    struct stat st;
+
+    if (rd->fd < 0) {
+	int fd = recursivecmd_openat(reccmd, rd[1].fd, "..", O_NOFOLLOW);
+
+	if (fd < 0)
+	    return -1;
+	if (fstat(fd, &st) || st.st_dev != rd->dev || st.st_ino != rd->ino) {
+	    close(fd);
+	    errno = ENOENT;
+	    return -1;
+	}
+	rd->fd = fd;
+    }
+    return rd->fd;
+}
+#endif
+
+/**/
+static int
+recursivecmd_doone(struct recursivecmd *reccmd,
+    char *arg, int dfd, char *rp, struct dirsav *ds, int first)
 {
     struct stat st, *sp = NULL;
 
-    if(reccmd->opt_recurse && !lstat(rp, &st)) {
+    if(reccmd->opt_recurse && !rec_lstat(dfd, rp, &st)) {
 	if(S_ISDIR(st.st_mode))
-	    return recursivecmd_dorec(reccmd, arg, rp, &st, ds, first);
+	    return recursivecmd_dorec(reccmd, arg, dfd, rp, &st, ds, first);
 	sp = &st;
     }
-    return reccmd->leaf_func(arg, rp, sp, reccmd->magic);
+    return reccmd->leaf_func(arg, dfd, rp, sp, reccmd->magic);
 }
 
 /**/
 static int
-recursivecmd_dorec(struct recursivecmd const *reccmd,
-    char *arg, char *rp, struct stat const *sp, struct dirsav *ds, int first)
+recursivecmd_dorec(struct recursivecmd *reccmd,
+    char *arg, int dfd, char *rp, struct stat const *sp, struct dirsav *ds,
+    int first)
 {
     char *fn;
     DIR *d;
     int err, err1;
+#ifdef RECURSE_AT
+    struct stat st;
+    int fd, level = -1;
+#else
     struct dirsav dsav;
+#endif
     char *files = NULL;
     int fileslen = 0;
 
-    err1 = reccmd->dirpre_func(arg, rp, sp, reccmd->magic);
+    err1 = reccmd->dirpre_func(arg, dfd, rp, sp, reccmd->magic);
     if(err1 & 2)
 	return 2;
 
+#ifdef RECURSE_AT
+    /*
+     * Below the top level, make sure what we open is still the
+     * directory we looked at, and not a link put in its place.
+     */
+    fd = recursivecmd_openat(reccmd, dfd, rp, first ? 0 : O_NOFOLLOW);
+    if (fd >= 0 && (fstat(fd, &st) || st.st_dev != sp->st_dev ||
+		    st.st_ino != sp->st_ino)) {
+	close(fd);
+	fd = -1;
+	errno = ENOTDIR;
+    }
+    if (fd < 0) {
+	if(!reccmd->opt_noerr)
+	    zwarnnam(reccmd->nam, "%s: %e", arg, errno);
+	return 1;
+    }
+    err = err1;
+
+    if (!(d = fdopendir(fd)))
+	close(fd);
+    else {
+	struct recdir *rd;
+
+	if (reccmd->depth == reccmd->ndirs) {
+	    int n = reccmd->ndirs ? 2 * reccmd->ndirs : 16;
+
+	    reccmd->dirs = (struct recdir *)
+		zrealloc(reccmd->dirs, n * sizeof(struct recdir));
+	    reccmd->ndirs = n;
+	}
+	level = reccmd->depth++;
+	rd = reccmd->dirs + level;
+	rd->fd = fd;
+	rd->dir = d;
+	rd->dev = st.st_dev;
+	rd->ino = st.st_ino;
+    }
+#else
     err = -lchdir(rp, ds, !first);
     if (err) {
 	if(!reccmd->opt_noerr)
@@ -476,6 +1133,7 @@ recursivecmd_dorec(struct recursivecmd const *reccmd,
 
     init_dirsav(&dsav);
     d = opendir(".");
+#endif
     if(!d) {
 	if(!reccmd->opt_noerr)
 	    zwarnnam(reccmd->nam, "%s: %e", arg, errno);
@@ -489,7 +1147,9 @@ recursivecmd_dorec(struct recursivecmd const *reccmd,
 	    strcpy(files + fileslen, fn);
 	    fileslen += l;
 	}
+#ifndef RECURSE_AT
 	closedir(d);
+#endif
 	for (fn = files; !errflag && !(err & 2) && fn < files + fileslen;) {
 	    int l = strlen(fn) + 1;
 	    VARARR(char, narg, arglen + l);
@@ -498,26 +1158,50 @@ recursivecmd_dorec(struct recursivecmd const *reccmd,
 	    narg[arglen-1] = '/';
 	    strcpy(narg + arglen, fn);
 	    unmetafy(fn, NULL);
-	    err |= recursivecmd_doone(reccmd, narg, fn, &dsav, 0);
+#ifdef RECURSE_AT
+	    err |= recursivecmd_doone(reccmd, narg, reccmd->dirs[level].fd,
+				      fn, NULL, 0);
+#else
+	    err |= recursivecmd_doone(reccmd, narg, REC_CWD, fn, &dsav, 0);
+#endif
 	    fn += l;
 	}
 	hrealloc(files, fileslen, 0);
+#ifdef RECURSE_AT
+	/* The directory above may have been closed further down */
+	if (level && !(err & 2) &&
+	    (dfd = recursivecmd_parent(reccmd, level)) < 0) {
+	    if(!reccmd->opt_noerr)
+		zwarnnam(reccmd->nam,
+			 "failed to return to previous directory: %e", errno);
+	    err |= 2;
+	}
+	if (reccmd->dirs[level].dir)
+	    closedir(reccmd->dirs[level].dir);
+	else if (reccmd->dirs[level].fd >= 0)
+	    close(reccmd->dirs[level].fd);
+	reccmd->depth--;
+#endif
     }
+#ifndef RECURSE_AT
     zsfree(dsav.dirname);
+#endif
     if (err & 2)
 	return 2;
+#ifndef RECURSE_AT
     if (restoredir(ds)) {
 	if(!reccmd->opt_noerr)
 	    zwarnnam(reccmd->nam, "failed to return to previous directory: %e",
 		     errno);
 	return 2;
     }
-    return err | reccmd->dirpost_func(arg, rp, sp, reccmd->magic);
+#endif
+    return err | reccmd->dirpost_func(arg, dfd, rp, sp, reccmd->magic);
 }
 
 /**/
 static int
-recurse_donothing(UNUSED(char *arg), UNUSED(char *rp), UNUSED(struct stat const *sp), UNUSED(void *magic))
+recurse_donothing(UNUSED(char *arg), UNUSED(int dfd), UNUSED(char *rp), UNUSED(struct stat const *sp), UNUSED(void *magic))
 {
     return 0;
 }
@@ -533,14 +1217,14 @@ struct rmmagic {
 
 /**/
 static int
-rm_leaf(char *arg, char *rp, struct stat const *sp, void *magic)
+rm_leaf(char *arg, int dfd, char *rp, struct stat const *sp, void *magic)
 {
     struct rmmagic *rmm = magic;
     struct stat st;
 
     if(!rmm->opt_unlinkdir || !rmm->opt_force) {
 	if(!sp) {
-	    if(!lstat(rp, &st))
+	    if(!rec_lstat(dfd, rp, &st))
 		sp = &st;
 	}
 	if(sp) {
@@ -560,7 +1244,7 @@ rm_leaf(char *arg, char *rp, struct stat const *sp, void *magic)
 		    return 0;
 	    } else if(!rmm->opt_force &&
 		    !S_ISLNK(sp->st_mode) &&
-		    access(rp, W_OK)) {
+		    rec_access(dfd, rp, W_OK)) {
 		nicezputs(rmm->nam, stderr);
 		fputs(": remove `", stderr);
 		nicezputs(arg, stderr);
@@ -572,7 +1256,7 @@ rm_leaf(char *arg, char *rp, struct stat const *sp, void *magic)
 	    }
 	}
     }
-    if(unlink(rp) && !rmm->opt_force) {
+    if(rec_unlink(dfd, rp) && !rmm->opt_force) {
 	zwarnnam(rmm->nam, "%s: %e", arg, errno);
 	return 1;
     }
@@ -581,7 +1265,8 @@ rm_leaf(char *arg, char *rp, struct stat const *sp, void *magic)
 
 /**/
 static int
-rm_dirpost(char *arg, char *rp, UNUSED(struct stat const *sp), void *magic)
+rm_dirpost(char *arg, int dfd, char *rp, UNUSED(struct stat const *sp),
+    void *magic)
 {
     struct rmmagic *rmm = magic;
 
@@ -594,7 +1279,7 @@ rm_dirpost(char *arg, char *rp, UNUSED(struct stat const *sp), void *magic)
 	if(!ask())
 	    return 0;
     }
-    if(rmdir(rp) && !rmm->opt_force) {
+    if(rec_rmdir(dfd, rp) && !rmm->opt_force) {
 	zwarnnam(rmm->nam, "%s: %e", arg, errno);
 	return 1;
     }
@@ -629,11 +1314,12 @@ struct chownmagic {
 
 /**/
 static int
-chown_dochown(char *arg, char *rp, UNUSED(struct stat const *sp), void *magic)
+chown_dochown(char *arg, int dfd, char *rp, UNUSED(struct stat const *sp),
+    void *magic)
 {
     struct chownmagic *chm = magic;
 
-    if(chown(rp, chm->uid, chm->gid)) {
+    if(rec_chown(dfd, rp, chm->uid, chm->gid)) {
 	zwarnnam(chm->nam, "%s: %e", arg, errno);
 	return 1;
     }
@@ -642,11 +1328,12 @@ chown_dochown(char *arg, char *rp, UNUSED(struct stat const *sp), void *magic)
 
 /**/
 static int
-chown_dolchown(char *arg, char *rp, UNUSED(struct stat const *sp), void *magic)
+chown_dolchown(char *arg, int dfd, char *rp, UNUSED(struct stat const *sp),
+    void *magic)
 {
     struct chownmagic *chm = magic;
 
-    if(lchown(rp, chm->uid, chm->gid)) {
+    if(rec_lchown(dfd, rp, chm->uid, chm->gid)) {
 	zwarnnam(chm->nam, "%s: %e", arg, errno);
 	return 1;
     }
@@ -755,6 +1442,7 @@ static struct builtin bintab[] = {
      * fully compatible. */
     BUILTIN("chgrp", 0, bin_chown, 2, -1, BIN_CHGRP, "hRs",    NULL),
     BUILTIN("chown", 0, bin_chown, 2, -1, BIN_CHOWN, "hRs",    NULL),
+    BUILTIN("cp",    0, bin_ln,    2, -1, BIN_CP,    "fipRr", NULL),
     BUILTIN("ln",    0, bin_ln,    1, -1, BIN_LN,    LN_OPTS, NULL),
     BUILTIN("mkdir", 0, bin_mkdir, 1, -1, 0,         "pm:",   NULL),
     BUILTIN("mv",    0, bin_ln,    2, -1, BIN_MV,    "fi",    NULL),
@@ -764,6 +1452,7 @@ static struct builtin bintab[] = {
     /* The "safe" zsh-only names */
     BUILTIN("zf_chgrp", 0, bin_chown, 2, -1, BIN_CHGRP, "hRs",    NULL),
     BUILTIN("zf_chown", 0, bin_chown, 2, -1, BIN_CHOWN, "hRs",    NULL),
+    BUILTIN("zf_cp",    0, bin_ln,    2, -1, BIN_CP,    "fipRr", NULL),
     BUILTIN("zf_ln",    0, bin_ln,    1, -1, BIN_LN,    LN_OPTS, NULL),
     BUILTIN("zf_mkdir", 0, bin_mkdir, 1, -1, 0,         "pm:",   NULL),
     BUILTIN("zf_mv",    0, bin_ln,    2, -1, BIN_MV,    "fi",    NULL),
@@ -525,7 +525,7 @@ static HashNode
 getprivatenode2(HashTable ht, const char *nam)
 {
     /* getparamnode() would follow autoloads, we must not do that here */
-    HashNode hn = gethashnode2(ht, nam);
+    HashNode hn = getparamnode2(ht, nam);
     Param pm = (Param) hn;
 
     while (!fakelevel && pm && locallevel > pm->level && is_private(pm))
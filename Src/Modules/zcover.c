@@ -0,0 +1,571 @@
+/*
+ * zcover.c - per-line execution counts and times for shell code
+ *
+ * This file is part of zsh, the Z shell.
+ *
+ * Copyright (c) 2026 Zsh Development Group
+ * All rights reserved.
+ *
+ * Permission is hereby granted, without written agreement and without
+ * license or royalty fees, to use, copy, modify, and distribute this
+ * software and to distribute modified versions of this software for any
+ * purpose, provided that the above copyright notice and the following
+ * two paragraphs appear in all copies of this software.
+ *
+ * In no event shall the Zsh Development Group be liable to any party for
+ * direct, indirect, special, incidental, or consequential damages arising
+ * out of the use of this software and its documentation, even if the Zsh
+ * Development Group have been advised of the possibility of such damage.
+ *
+ * The Zsh Development Group specifically disclaim any warranties,
+ * including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose.  The software
+ * provided hereunder is on an "as is" basis, and the Zsh Development
+ * Group have no obligation to provide maintenance, support, updates,
+ * enhancements, or modifications.
+ *
+ */
+
+#include "zcover.mdh"
+#include "zcover.pro"
+
+#include <sys/time.h>
+
+/*
+ * For each file, the number of times a command started on each line
+ * and the time in microseconds from then until the next command
+ * started.  Lines on which a command could start are marked as code
+ * whether or not one ever did, so that lines never run can be told
+ * from those with nothing on them.
+ */
+
+struct covline {
+    zlong count;
+    zlong usec;
+    int code;
+};
+
+typedef struct covfile *Covfile;
+
+struct covfile {
+    struct hashnode node;
+    zlong ncounts;
+    struct covline *counts;
+};
+
+static HashTable covtab;
+
+/* The line last started, which is charged for the time until the next */
+
+static Covfile curfile;
+static zlong curlnum;
+static struct timeval lasttv;
+
+/**/
+static void
+freecovnode(HashNode hn)
+{
+    Covfile cf = (Covfile) hn;
+
+    zsfree(cf->node.nam);
+    if (cf->counts)
+	zfree(cf->counts, cf->ncounts * sizeof(struct covline));
+    zfree(cf, sizeof(struct covfile));
+}
+
+/**/
+static void
+createcovtab(void)
+{
+    covtab = newhashtable(31, "covtab", NULL);
+
+    covtab->hash        = hasher;
+    covtab->emptytable  = emptyhashtable;
+    covtab->filltable   = NULL;
+    covtab->cmpnodes    = strcmp;
+    covtab->addnode     = addhashnode;
+    covtab->getnode     = gethashnode2;
+    covtab->getnode2    = gethashnode2;
+    covtab->removenode  = removehashnode;
+    covtab->disablenode = NULL;
+    covtab->enablenode  = NULL;
+    covtab->freenode    = freecovnode;
+    covtab->printnode   = NULL;
+}
+
+/* Charge the time since the last line started to that line. */
+
+static void
+cover_charge(struct timeval *now)
+{
+    if (curfile)
+	curfile->counts[curlnum].usec +=
+	    (now->tv_sec - lasttv.tv_sec) * (zlong)1000000 +
+	    (now->tv_usec - lasttv.tv_usec);
+    lasttv = *now;
+}
+
+/* Make sure there is an entry for a line of a file. */
+
+static void
+cover_grow(Covfile cf, zlong line)
+{
+    zlong n;
+
+    if (line < cf->ncounts)
+	return;
+    n = cf->ncounts ? 2 * cf->ncounts : 64;
+    while (n <= line)
+	n *= 2;
+    cf->counts = (struct covline *)
+	zrealloc(cf->counts, n * sizeof(struct covline));
+    memset(cf->counts + cf->ncounts, 0,
+	   (n - cf->ncounts) * sizeof(struct covline));
+    cf->ncounts = n;
+}
+
+/*
+ * Mark the line of a file on which a command starts, given the line
+ * number stored in the code and the offset from that to the file.
+ */
+
+static void
+cover_mark(Covfile cf, wordcode lnum, zlong off)
+{
+    zlong line;
+
+    if (!lnum)
+	return;
+    if ((line = off + lnum - 1) < 0)
+	line = 0;
+    cover_grow(cf, line);
+    cf->counts[line].code = 1;
+}
+
+/*
+ * Find the lines of code in a program by walking its structure as
+ * exec.c and loop.c do, without running anything.  Each returns the
+ * position after what it walked, if the caller needs it.
+ */
+
+static Wordcode cover_walklist(Covfile cf, Wordcode pc, zlong off);
+static Wordcode cover_walksublist(Covfile cf, Wordcode pc, zlong off);
+
+static void
+cover_walkcmd(Covfile cf, Wordcode pc, zlong off, wordcode lnum)
+{
+    Wordcode end, next;
+    wordcode code;
+
+    while (wc_code(*pc) == WC_REDIR)
+	pc += WC_REDIR_WORDS(*pc);
+    code = *pc++;
+    switch (wc_code(code)) {
+    case WC_SUBSH:
+    case WC_CURSH:
+    case WC_REPEAT:
+	if (wc_code(code) == WC_REPEAT)
+	    pc++;
+	cover_walklist(cf, pc, off);
+	break;
+    case WC_TIMED:
+	if (WC_TIMED_TYPE(code) == WC_TIMED_PIPE)
+	    cover_walksublist(cf, pc, off);
+	break;
+    case WC_FUNCDEF:
+	/* The names, then the offset and sizes of the strings */
+	pc += *pc + 4;
+	/* Lines in the body count from the definition, see execfuncdef() */
+	while (wc_code(*pc) == WC_LIST)
+	    pc = cover_walklist(cf, pc, (zlong)lnum - 1);
+	break;
+    case WC_FOR:
+	if (WC_FOR_TYPE(code) == WC_FOR_COND)
+	    pc += 3;
+	else {
+	    pc += *pc + 1;
+	    if (WC_FOR_TYPE(code) == WC_FOR_LIST)
+		pc += *pc + 1;
+	}
+	cover_walklist(cf, pc, off);
+	break;
+    case WC_SELECT:
+	pc++;
+	if (WC_SELECT_TYPE(code) == WC_SELECT_LIST)
+	    pc += *pc + 1;
+	cover_walklist(cf, pc, off);
+	break;
+    case WC_WHILE:
+	pc = cover_walklist(cf, pc, off);
+	cover_walklist(cf, pc, off);
+	break;
+    case WC_CASE:
+	end = pc + WC_CASE_SKIP(code);
+	for (pc++; pc < end && wc_code(code = *pc++) == WC_CASE; pc = next) {
+	    next = pc + WC_CASE_SKIP(code);
+	    /* Each alternative is a pattern and its number */
+	    cover_walklist(cf, pc + 2 * *pc + 1, off);
+	}
+	break;
+    case WC_IF:
+	end = pc + WC_IF_SKIP(code);
+	for (; pc < end && wc_code(code = *pc++) == WC_IF; pc = next) {
+	    next = pc + WC_IF_SKIP(code);
+	    if (WC_IF_TYPE(code) != WC_IF_ELSE)
+		pc = cover_walklist(cf, pc, off);
+	    cover_walklist(cf, pc, off);
+	}
+	break;
+    case WC_TRY:
+	pc = cover_walklist(cf, pc + 1, off);
+	cover_walklist(cf, pc, off);
+	break;
+    }
+}
+
+static Wordcode
+cover_walksublist(Covfile cf, Wordcode pc, zlong off)
+{
+    wordcode code = *pc++;
+    Wordcode next = pc + WC_SUBLIST_SKIP(code);
+
+    if (WC_SUBLIST_FLAGS(code) & WC_SUBLIST_SIMPLE) {
+	cover_mark(cf, *pc, off);
+	cover_walkcmd(cf, pc + 1, off, *pc);
+	return next;
+    }
+    for (;;) {
+	code = *pc++;
+	cover_mark(cf, WC_PIPE_LINENO(code), off);
+	if (WC_PIPE_TYPE(code) == WC_PIPE_END) {
+	    cover_walkcmd(cf, pc, off, WC_PIPE_LINENO(code));
+	    break;
+	}
+	cover_walkcmd(cf, pc + 1, off, WC_PIPE_LINENO(code));
+	pc += *pc;
+    }
+    return next;
+}
+
+static Wordcode
+cover_walklist(Covfile cf, Wordcode pc, zlong off)
+{
+    wordcode code, scode;
+
+    /* An empty list is just an end marker */
+    if (wc_code(*pc) != WC_LIST)
+	return pc + 1;
+    do {
+	code = *pc++;
+	if (WC_LIST_TYPE(code) & Z_SIMPLE) {
+	    Wordcode next = pc + WC_LIST_SKIP(code);
+
+	    cover_mark(cf, *pc, off);
+	    cover_walkcmd(cf, pc + 1, off, *pc);
+	    pc = next;
+	} else {
+	    do {
+		scode = *pc;
+		pc = cover_walksublist(cf, pc, off);
+	    } while (WC_SUBLIST_TYPE(scode) != WC_SUBLIST_END);
+	}
+    } while (!(WC_LIST_TYPE(code) & Z_END) && wc_code(*pc) == WC_LIST);
+    return pc;
+}
+
+/* The hook called by the shell as each command starts. */
+
+static void
+cover_line(Estate state)
+{
+    struct timezone dummy_tz;
+    struct timeval now;
+    zlong line;
+    char *file = execfileline(&line);
+
+    gettimeofday(&now, &dummy_tz);
+    cover_charge(&now);
+
+    if (!curfile || strcmp(curfile->node.nam, file)) {
+	if (!(curfile = (Covfile) covtab->getnode2(covtab, file))) {
+	    curfile = (Covfile) zshcalloc(sizeof(struct covfile));
+	    covtab->addnode(covtab, ztrdup(file), curfile);
+	}
+    }
+    /*
+     * The first time a program runs, find all its lines of code, with
+     * the same offset from its line numbers to the file's as this one.
+     */
+    if (!(state->prog->flags & EF_COVER)) {
+	Wordcode pc = state->prog->prog;
+
+	state->prog->flags |= EF_COVER;
+	while (wc_code(*pc) == WC_LIST)
+	    pc = cover_walklist(curfile, pc, line - lineno);
+    }
+    if (line < 0)
+	line = 0;
+    cover_grow(curfile, line);
+    curfile->counts[line].count++;
+    curfile->counts[line].code = 1;
+    curlnum = line;
+}
+
+/**/
+static void
+cover_start(void)
+{
+    struct timezone dummy_tz;
+
+    if (execlinehook == cover_line)
+	return;
+    curfile = NULL;
+    gettimeofday(&lasttv, &dummy_tz);
+    execlinehook = cover_line;
+}
+
+/**/
+static void
+cover_stop(void)
+{
+    struct timezone dummy_tz;
+    struct timeval now;
+
+    if (execlinehook != cover_line)
+	return;
+    gettimeofday(&now, &dummy_tz);
+    cover_charge(&now);
+    curfile = NULL;
+    execlinehook = NULL;
+}
+
+/*
+ * Start a line of a listing with the count, the time in milliseconds
+ * and the line number; the first two are blank for lines that never ran.
+ */
+
+static void
+cover_prefix(Covfile cf, zlong line)
+{
+    if (line < cf->ncounts && cf->counts[line].count)
+#if defined(ZLONG_IS_LONG_LONG) && defined(PRINTF_HAS_LLD)
+	printf("%10lld %10.3f", cf->counts[line].count,
+#else
+	printf("%10ld %10.3f", (long)cf->counts[line].count,
+#endif
+	       cf->counts[line].usec / 1e3);
+    else
+	printf("%21s", "");
+#if defined(ZLONG_IS_LONG_LONG) && defined(PRINTF_HAS_LLD)
+    printf(" %6lld", line);
+#else
+    printf(" %6ld", (long)line);
+#endif
+}
+
+/* List the counts for a file alongside its contents, if we can read it. */
+
+static void
+cover_annotate(Covfile cf)
+{
+    FILE *in = *cf->node.nam ? fopen(unmeta(cf->node.nam), "r") : NULL;
+    char buf[BUFSIZ];
+    zlong line = 1;
+    int bol = 1;
+
+    printf("%s\n", *cf->node.nam ? cf->node.nam : "(unknown)");
+    /* Line 0 gathers code the shell can't place */
+    if (cf->counts[0].count) {
+	cover_prefix(cf, 0);
+	putchar('\n');
+    }
+    if (in) {
+	while (fgets(buf, sizeof(buf), in)) {
+	    if (bol) {
+		cover_prefix(cf, line++);
+		putchar(' ');
+	    }
+	    fputs(buf, stdout);
+	    bol = buf[strlen(buf) - 1] == '\n';
+	}
+	if (!bol)
+	    putchar('\n');
+	fclose(in);
+    }
+    for (; line < cf->ncounts; line++)
+	if (cf->counts[line].count) {
+	    cover_prefix(cf, line);
+	    putchar('\n');
+	}
+}
+
+/*
+ * List the counts for a file as an lcov tracefile record.  Every line
+ * of code is listed, so those that never ran count against the file.
+ */
+
+static void
+cover_lcov(Covfile cf)
+{
+    zlong line;
+    int hit = 0, found = 0;
+
+    printf("TN:\nSF:%s\n", cf->node.nam);
+    for (line = 1; line < cf->ncounts; line++) {
+	if (!cf->counts[line].code)
+	    continue;
+#if defined(ZLONG_IS_LONG_LONG) && defined(PRINTF_HAS_LLD)
+	printf("DA:%lld,%lld\n", line, cf->counts[line].count);
+#else
+	printf("DA:%ld,%ld\n", (long)line, (long)cf->counts[line].count);
+#endif
+	found++;
+	if (cf->counts[line].count)
+	    hit++;
+    }
+    printf("LH:%d\nLF:%d\nend_of_record\n", hit, found);
+}
+
+/* Return 1 if any line of a file ran since the counts were discarded. */
+
+static int
+cover_ran(Covfile cf)
+{
+    zlong line;
+
+    for (line = 0; line < cf->ncounts; line++)
+	if (cf->counts[line].count)
+	    return 1;
+    return 0;
+}
+
+static int
+cover_cmp(const void *a, const void *b)
+{
+    return strcmp((*(Covfile *)a)->node.nam, (*(Covfile *)b)->node.nam);
+}
+
+/**/
+static int
+bin_zcover(char *nam, char **args, Options ops, UNUSED(int func))
+{
+    if (OPT_ISSET(ops,'s') || OPT_ISSET(ops,'e') || OPT_ISSET(ops,'c')) {
+	if (*args) {
+	    zwarnnam(nam, "too many arguments");
+	    return 1;
+	}
+	if (OPT_ISSET(ops,'s'))
+	    cover_start();
+	else if (OPT_ISSET(ops,'e'))
+	    cover_stop();
+	else {
+	    /*
+	     * Programs already seen aren't walked again, so keep
+	     * the lines of code found in them.
+	     */
+	    HashNode hn;
+	    int i;
+
+	    curfile = NULL;
+	    for (i = 0; i < covtab->hsize; i++)
+		for (hn = covtab->nodes[i]; hn; hn = hn->next) {
+		    Covfile cf = (Covfile) hn;
+		    zlong line;
+
+		    for (line = 0; line < cf->ncounts; line++)
+			cf->counts[line].count = cf->counts[line].usec = 0;
+		}
+	}
+    } else if (*args) {
+	int ret = 0;
+
+	for (; *args; args++) {
+	    Covfile cf = (Covfile) covtab->getnode2(covtab, *args);
+
+	    if (!cf || !cover_ran(cf)) {
+		zwarnnam(nam, "no counts for %s", *args);
+		ret = 1;
+	    } else if (OPT_ISSET(ops,'l'))
+		cover_lcov(cf);
+	    else
+		cover_annotate(cf);
+	}
+	return ret;
+    } else {
+	VARARR(Covfile, list, covtab->ct + 1);
+	HashNode hn;
+	int i, n = 0;
+
+	for (i = 0; i < covtab->hsize; i++)
+	    for (hn = covtab->nodes[i]; hn; hn = hn->next)
+		if (cover_ran((Covfile) hn))
+		    list[n++] = (Covfile) hn;
+	qsort(list, n, sizeof(*list), cover_cmp);
+	for (i = 0; i < n; i++) {
+	    if (OPT_ISSET(ops,'l'))
+		cover_lcov(list[i]);
+	    else
+		cover_annotate(list[i]);
+	}
+    }
+    return 0;
+}
+
+static struct builtin bintab[] = {
+    BUILTIN("zcover", 0, bin_zcover, 0, -1, 0, "cels", NULL),
+};
+
+static struct features module_features = {
+    bintab, sizeof(bintab)/sizeof(*bintab),
+    NULL, 0,
+    NULL, 0,
+    NULL, 0,
+    0
+};
+
+/**/
+int
+setup_(UNUSED(Module m))
+{
+    return 0;
+}
+
+/**/
+int
+features_(Module m, char ***features)
+{
+    *features = featuresarray(m, &module_features);
+    return 0;
+}
+
+/**/
+int
+enables_(Module m, int **enables)
+{
+    return handlefeatures(m, &module_features, enables);
+}
+
+/**/
+int
+boot_(UNUSED(Module m))
+{
+    createcovtab();
+    return 0;
+}
+
+/**/
+int
+cleanup_(Module m)
+{
+    cover_stop();
+    deletehashtable(covtab);
+    covtab = NULL;
+    return setfeatureenables(m, &module_features, NULL);
+}
+
+/**/
+int
+finish_(UNUSED(Module m))
+{
+    return 0;
+}
@@ -0,0 +1,342 @@
+/*
+ * zsample.c - a sampling profiler for shell code
+ *
+ * This file is part of zsh, the Z shell.
+ *
+ * Copyright (c) 2026 Zsh Development Group
+ * All rights reserved.
+ *
+ * Permission is hereby granted, without written agreement and without
+ * license or royalty fees, to use, copy, modify, and distribute this
+ * software and to distribute modified versions of this software for any
+ * purpose, provided that the above copyright notice and the following
+ * two paragraphs appear in all copies of this software.
+ *
+ * In no event shall the Zsh Development Group be liable to any party for
+ * direct, indirect, special, incidental, or consequential damages arising
+ * out of the use of this software and its documentation, even if the Zsh
+ * Development Group have been advised of the possibility of such damage.
+ *
+ * The Zsh Development Group specifically disclaim any warranties,
+ * including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose.  The software
+ * provided hereunder is on an "as is" basis, and the Zsh Development
+ * Group have no obligation to provide maintenance, support, updates,
+ * enhancements, or modifications.
+ *
+ */
+
+#include "zsample.mdh"
+#include "zsample.pro"
+
+#include <sys/time.h>
+
+/*
+ * Each sample is the stack of shell functions and sourced files
+ * active when the profiling timer fired, outermost first, followed
+ * by the file and line being executed, all separated by semicolons.
+ * That is the "folded" form read by flame graph tools.  Identical
+ * stacks are counted in a hash table allocated when sampling starts,
+ * since the signal handler can't allocate memory; stacks that don't
+ * fit are dropped and counted.
+ */
+
+#define SAMPLE_KEYLEN 512
+#define SAMPLE_SLOTS 2048
+
+struct sample {
+    zlong count;
+    unsigned int hash;
+    char key[SAMPLE_KEYLEN];
+};
+
+static struct sample *samples;
+static int nsamples, dropped;
+
+/* Non-zero while the timer is running */
+
+static int sampling;
+
+static struct sigaction oldact;
+
+/* Append a string to a sample, as much as fits before end. */
+
+static char *
+sample_add(char *p, char *end, const char *s)
+{
+    while (*s && p < end)
+	*p++ = *s++;
+    return p;
+}
+
+/* Append a line number to a sample. */
+
+static char *
+sample_addnum(char *p, char *end, zlong n)
+{
+    char buf[DIGBUFSIZE], *b = buf + sizeof(buf);
+
+    *--b = '\0';
+    if (n < 0)
+	n = 0;
+    do {
+	*--b = '0' + (int)(n % 10);
+	n /= 10;
+    } while (n);
+    return sample_add(p, end, b);
+}
+
+/*
+ * The handler for SIGPROF.  This runs whatever the shell was in the
+ * middle of, so it only reads the function stack and writes to the
+ * table; it mustn't call anything that might allocate.
+ */
+
+static void
+sample_handler(UNUSED(int sig))
+{
+    char key[SAMPLE_KEYLEN], *p = key, *end;
+    Funcstack stack[64], f;
+    struct sample *s;
+    unsigned int hash;
+    int depth = 0, i;
+    zlong line;
+    char *file = execfileline(&line);
+
+    for (f = funcstack; f && depth < (int)(sizeof(stack)/sizeof(*stack));
+	 f = f->prev)
+	stack[depth++] = f;
+
+    /* Leave room for the file and line at the end. */
+    end = key + SAMPLE_KEYLEN - 1 - strlen(file) - DIGBUFSIZE;
+    if (end < key)
+	end = key;
+    while (depth--) {
+	if (p + strlen(stack[depth]->name) + 1 >= end)
+	    break;
+	p = sample_add(p, end, stack[depth]->name);
+	*p++ = ';';
+    }
+    end = key + SAMPLE_KEYLEN - 1;
+    p = sample_add(p, end, file);
+    p = sample_add(p, end, ":");
+    p = sample_addnum(p, end, line);
+    *p = '\0';
+
+    for (hash = 0, p = key; *p; p++)
+	hash = hash * 31 + STOUC(*p);
+    for (i = hash & (SAMPLE_SLOTS - 1);; i = (i + 1) & (SAMPLE_SLOTS - 1)) {
+	s = samples + i;
+	if (!s->count) {
+	    /* Keep the table no more than three quarters full. */
+	    if (nsamples >= SAMPLE_SLOTS / 4 * 3) {
+		dropped++;
+		return;
+	    }
+	    strcpy(s->key, key);
+	    s->hash = hash;
+	    s->count = 1;
+	    nsamples++;
+	    return;
+	}
+	if (s->hash == hash && !strcmp(s->key, key)) {
+	    s->count++;
+	    return;
+	}
+    }
+}
+
+/*
+ * Start the timer, firing every interval microseconds of CPU time,
+ * or re-arm it with a new interval if it is already running.
+ */
+
+static int
+sample_start(char *nam, long interval)
+{
+    struct sigaction act;
+    struct itimerval it;
+
+    if (!samples) {
+	samples = (struct sample *) zshcalloc(SAMPLE_SLOTS *
+					      sizeof(struct sample));
+	nsamples = dropped = 0;
+    }
+    if (!sampling) {
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = sample_handler;
+	sigemptyset(&act.sa_mask);
+	act.sa_flags = SA_RESTART;
+	if (sigaction(SIGPROF, &act, &oldact)) {
+	    zwarnnam(nam, "can't handle SIGPROF: %e", errno);
+	    return 1;
+	}
+    }
+    it.it_interval.tv_sec = it.it_value.tv_sec = interval / 1000000;
+    it.it_interval.tv_usec = it.it_value.tv_usec = interval % 1000000;
+    if (setitimer(ITIMER_PROF, &it, NULL)) {
+	zwarnnam(nam, "can't start timer: %e", errno);
+	if (!sampling)
+	    sigaction(SIGPROF, &oldact, NULL);
+	return 1;
+    }
+    sampling = sampletimer = 1;
+    return 0;
+}
+
+/* Stop the timer. */
+
+static void
+sample_stop(void)
+{
+    struct itimerval it;
+
+    if (!sampling)
+	return;
+    memset(&it, 0, sizeof(it));
+    setitimer(ITIMER_PROF, &it, NULL);
+    sigaction(SIGPROF, &oldact, NULL);
+    sampling = sampletimer = 0;
+}
+
+/* Discard the samples. */
+
+static void
+sample_clear(void)
+{
+    sigset_t oset = signal_block(signal_mask(SIGPROF));
+
+    if (samples)
+	memset(samples, 0, SAMPLE_SLOTS * sizeof(struct sample));
+    nsamples = dropped = 0;
+    signal_setmask(oset);
+}
+
+/* Order samples with the most frequent first. */
+
+static int
+sample_cmp(const void *a, const void *b)
+{
+    const struct sample *sa = *(const struct sample **)a;
+    const struct sample *sb = *(const struct sample **)b;
+
+    if (sa->count != sb->count)
+	return sa->count > sb->count ? -1 : 1;
+    return strcmp(sa->key, sb->key);
+}
+
+/* Print the samples in folded form. */
+
+static void
+sample_list(char *nam)
+{
+    sigset_t oset = signal_block(signal_mask(SIGPROF));
+    VARARR(struct sample *, list, nsamples + 1);
+    int i, n = 0;
+
+    if (samples)
+	for (i = 0; i < SAMPLE_SLOTS; i++)
+	    if (samples[i].count)
+		list[n++] = samples + i;
+    qsort(list, n, sizeof(*list), sample_cmp);
+    for (i = 0; i < n; i++) {
+	fputs(unmeta(list[i]->key), stdout);
+#if defined(ZLONG_IS_LONG_LONG) && defined(PRINTF_HAS_LLD)
+	printf(" %lld\n", list[i]->count);
+#else
+	printf(" %ld\n", (long)list[i]->count);
+#endif
+    }
+    if (dropped)
+	zwarnnam(nam, "%d samples dropped", dropped);
+    signal_setmask(oset);
+}
+
+/**/
+static int
+bin_zsample(char *nam, char **args, Options ops, UNUSED(int func))
+{
+    if (OPT_ISSET(ops,'s')) {
+	long interval = 1000;
+
+	if (*args) {
+	    char *eptr;
+
+	    interval = zstrtol(*args, &eptr, 10);
+	    if (*eptr || interval <= 0) {
+		zwarnnam(nam, "invalid interval: %s", *args);
+		return 1;
+	    }
+	}
+	return sample_start(nam, interval);
+    } else if (*args) {
+	zwarnnam(nam, "too many arguments");
+	return 1;
+    }
+    if (OPT_ISSET(ops,'e'))
+	sample_stop();
+    else if (OPT_ISSET(ops,'c'))
+	sample_clear();
+    else
+	sample_list(nam);
+    return 0;
+}
+
+static struct builtin bintab[] = {
+    BUILTIN("zsample", 0, bin_zsample, 0, 1, 0, "ces", NULL),
+};
+
+static struct features module_features = {
+    bintab, sizeof(bintab)/sizeof(*bintab),
+    NULL, 0,
+    NULL, 0,
+    NULL, 0,
+    0
+};
+
+/**/
+int
+setup_(UNUSED(Module m))
+{
+    return 0;
+}
+
+/**/
+int
+features_(Module m, char ***features)
+{
+    *features = featuresarray(m, &module_features);
+    return 0;
+}
+
+/**/
+int
+enables_(Module m, int **enables)
+{
+    return handlefeatures(m, &module_features, enables);
+}
+
+/**/
+int
+boot_(UNUSED(Module m))
+{
+    return 0;
+}
+
+/**/
+int
+cleanup_(Module m)
+{
+    sample_stop();
+    if (samples)
+	zfree(samples, SAMPLE_SLOTS * sizeof(struct sample));
+    samples = NULL;
+    return setfeatureenables(m, &module_features, NULL);
+}
+
+/**/
+int
+finish_(UNUSED(Module m))
+{
+    return 0;
+}
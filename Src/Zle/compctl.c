@@ -2110,6 +2110,8 @@ dumphashtable(HashTable ht, int what)
 
     addwhat = what;
 
+    if (ht == realparamtab)
+	importallenv();
     for (i = 0; i < ht->hsize; i++)
 	for (hn = ht->nodes[i]; hn; hn = hn->next)
 	    addmatch(dupstring(hn->nam), (char *) hn);
@@ -531,6 +531,15 @@ typedef REFRESH_ELEMENT *REFRESH_STRING;
 #endif
 
 
+/*
+ * Handler for an event registered from C by a module: see addzlewatch(),
+ * addzletimer() and addzlechild().  The arguments are the fd, timer
+ * number or process ID; for an fd, non-zero if an error was detected,
+ * for a child its exit status as for $?, else 0; and the data pointer
+ * passed when the handler was added.
+ */
+typedef void (*ZleEventFunc) _((int, int, void *));
+
 typedef struct watch_fd *Watch_fd;
 
 struct watch_fd {
@@ -540,4 +549,30 @@ struct watch_fd {
     int fd;
     /* 1 if func is called as a widget */
     int widget;
+    /* If not NULL, call this instead of func */
+    ZleEventFunc cfunc;
+    void *data;
+};
+
+typedef struct zle_event *Zle_event;
+
+/*
+ * A timer or a child process zle is waiting for while reading input.
+ * Shell handlers are identified by the function name for timers and
+ * by the process ID for children; C handlers by id.
+ */
+
+struct zle_event {
+    Zle_event next;
+    /* Timer number or process ID */
+    int id;
+    /* For a timer, when it is due, in milliseconds */
+    zlong when;
+    /* Function to call */
+    char *func;
+    /* 1 if func is called as a widget */
+    int widget;
+    /* If not NULL, call this instead of func */
+    ZleEventFunc cfunc;
+    void *data;
 };
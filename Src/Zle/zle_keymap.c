@@ -50,6 +50,7 @@
 
 typedef struct keymapname *KeymapName;
 typedef struct key *Key;
+typedef struct keytrie *KeyTrie;
 
 struct keymapname {
     HashNode next;	/* next in the hash chain */
@@ -78,6 +79,7 @@ struct keymap {
     KeymapName primary;
     int flags;		/* various flags (see below) */
     int rc;		/* reference count */
+    KeyTrie *trie;	/* bindings indexed by first byte, see below */
 };
 
 #define KM_IMMUTABLE (1<<1)
@@ -90,6 +92,27 @@ struct key {
     int prefixct;	/* number of sequences for which this is a prefix */
 };
 
+/*
+ * For reading keys, the bindings of a keymap are compiled into a tree
+ * with a level for each input byte, so that a sequence is resolved by
+ * a single walk down the tree instead of looking up each of its
+ * prefixes in the hash table as it arrives.  The tree is built when
+ * first needed and discarded whenever a binding in the keymap changes;
+ * it refers to the thingies and strings of the keymap without taking
+ * its own copies.  Bindings can change while a key is awaited, from
+ * zle -F handlers or scheduled functions, so keytriegen counts the
+ * trees discarded and a reader holding nodes starts again from keybuf
+ * when it changes.
+ */
+
+struct keytrie {
+    KeyTrie child;	/* first node for a longer sequence */
+    KeyTrie sibling;	/* next node for the same prefix */
+    Thingy bind;	/* binding, t_undefinedkey if none */
+    char *str;		/* string for send-string (metafied) */
+    int c;		/* input byte leading to this node */
+};
+
 /* This structure is used when listing keymaps. */
 
 struct bindstate {
@@ -140,6 +163,11 @@ int keybuflen;
 
 static int keybufsz = 20;
 
+/* number of keymap tree nodes examined reading the last key sequence */
+
+/**/
+int keyprobes;
+
 /* last command executed with execute-named-command */
 
 static Thingy lastnamed;
@@ -345,6 +373,7 @@ deletekeymap(Keymap km)
 {
     int i;
 
+    freekeytrie(km);
     deletehashtable(km->multi);
     for(i = 256; i--; )
 	unrefthingy(km->first[i]);
@@ -553,6 +582,7 @@ bindkey(Keymap km, const char *seq, Thingy bind, char *str)
 	return 1;
     if(!*seq)
 	return 2;
+    freekeytrie(km);
     if(!bind || ztrlen(seq) > 1) {
 	/* key needs to become a prefix if isn't one already */
 	if(km->first[f]) {
@@ -654,26 +684,141 @@ keybind(Keymap km, char *seq, char **strp)
     return k->bind;
 }
 
-/* Check whether a key sequence is a prefix of a longer bound sequence. *
- * One oddity: if *nothing* in the keymap is bound, this returns true   *
- * for the empty sequence, even though this is not strictly accurate.   */
+/* Number of trees of bindings freed so far */
+
+static int keytriegen;
+
+/* Free the tree of bindings used for reading keys, if any. */
 
 /**/
-static int
-keyisprefix(Keymap km, char *seq)
+static void
+freekeytrienodes(KeyTrie kt)
 {
-    Key k;
+    KeyTrie next;
 
-    if(!*seq)
-	return 1;
-    if(ztrlen(seq) == 1) {
-	int f = seq[0] == Meta ? STOUC(seq[1])^32 : STOUC(seq[0]);
+    for (; kt; kt = next) {
+	next = kt->sibling;
+	freekeytrienodes(kt->child);
+	zfree(kt, sizeof(*kt));
+    }
+}
 
-	if(km->first[f])
-	    return 0;
+/**/
+static void
+freekeytrie(Keymap km)
+{
+    int i;
+
+    if (!km->trie)
+	return;
+    for (i = 0; i < 256; i++)
+	freekeytrienodes(km->trie[i]);
+    zfree(km->trie, 256 * sizeof(KeyTrie));
+    km->trie = NULL;
+    keytriegen++;
+}
+
+/* Find or add the node for byte c below the node kt. */
+
+static KeyTrie
+keytriechild(KeyTrie *ktp, int c)
+{
+    KeyTrie kt;
+
+    for (kt = *ktp; kt; kt = kt->sibling)
+	if (kt->c == c)
+	    return kt;
+    kt = (KeyTrie) zshcalloc(sizeof(*kt));
+    kt->c = c;
+    kt->bind = t_undefinedkey;
+    kt->sibling = *ktp;
+    *ktp = kt;
+    return kt;
+}
+
+static Keymap bkt_km;
+
+/**/
+static void
+scankeytrie(HashNode hn, UNUSED(int flags))
+{
+    Key k = (Key) hn;
+    char *seq = dupstring(k->nam);
+    int len, i;
+    KeyTrie kt;
+
+    unmetafy(seq, &len);
+    /* a single character binding overrides any longer ones */
+    if (bkt_km->first[STOUC(*seq)])
+	return;
+    kt = keytriechild(bkt_km->trie + STOUC(*seq), STOUC(*seq));
+    for (i = 1; i < len; i++)
+	kt = keytriechild(&kt->child, STOUC(seq[i]));
+    kt->bind = k->bind;
+    kt->str = k->str;
+}
+
+/**/
+static void
+buildkeytrie(Keymap km)
+{
+    int i;
+
+    km->trie = (KeyTrie *) zshcalloc(256 * sizeof(KeyTrie));
+    for (i = 0; i < 256; i++) {
+	if (km->first[i]) {
+	    KeyTrie kt = keytriechild(km->trie + i, i);
+	    kt->bind = km->first[i];
+	}
     }
-    k = (Key) km->multi->getnode(km->multi, seq);
-    return k && k->prefixct;
+    bkt_km = km;
+    queue_signals();
+    pushheap();
+    scanhashtable(km->multi, 0, 0, 0, scankeytrie, 0);
+    popheap();
+    unqueue_signals();
+}
+
+/*
+ * Move along the tree of bindings for km after reading the byte c.
+ * kt is the node for the sequence so far; if start is set this is
+ * the first byte of the sequence.  Returns NULL if no binding
+ * starts with the sequence.
+ */
+
+static KeyTrie
+keytriestep(Keymap km, KeyTrie kt, int c, int start)
+{
+    keyprobes++;
+    if (start) {
+	if (!km->trie)
+	    buildkeytrie(km);
+	return km->trie[c];
+    }
+    for (kt = kt ? kt->child : NULL; kt; kt = kt->sibling)
+	if (kt->c == c)
+	    break;
+    return kt;
+}
+
+/* Walk the tree of bindings for km from the top for all of keybuf. */
+
+static KeyTrie
+keytriewalk(Keymap km)
+{
+    KeyTrie kt = NULL;
+    char *ptr = keybuf, *end = keybuf + keybuflen;
+    int c, start = 1;
+
+    while (ptr < end) {
+	c = STOUC(*ptr++);
+	if (c == Meta && ptr < end)
+	    c = STOUC(*ptr++) ^ 32;
+	if (!(kt = keytriestep(km, kt, c, start)))
+	    break;
+	start = 0;
+    }
+    return kt;
 }
 
 /*******************/
@@ -1566,10 +1711,12 @@ getkeymapcmd(Keymap km, Thingy *funcp, char **strp)
     Thingy func = t_undefinedkey;
     char *str = NULL;
     int lastlen = 0, lastc = lastchar;
-    int timeout = 0;
+    int timeout = 0, c, start = 1, gen = keytriegen;
+    KeyTrie kpos = NULL, lpos = NULL;
 
     keybuflen = 0;
     keybuf[0] = 0;
+    keyprobes = 0;
     /*
      * getkeybuf returns multibyte strings, which may not
      * yet correspond to complete wide characters, regardless
@@ -1583,20 +1730,42 @@ getkeymapcmd(Keymap km, Thingy *funcp, char **strp)
      * arbitrary functions, just so long as the string used in the
      * argument to bindkey is in the correct form for the locale.
      * That's beyond our control.
+     *
+     * The bindings are looked up by walking down the trees of
+     * bindings for the keymaps a byte at a time; this gives the same
+     * answer as keybind() on the whole of keybuf, and tells us
+     * whether keybuf is a prefix of a longer binding.
      */
-    while(getkeybuf(timeout) != EOF) {
-	char *s;
-	Thingy f;
+    while((c = getkeybuf(timeout)) != EOF) {
+	char *s = NULL;
+	Thingy f = t_undefinedkey;
 	int loc = !!localkeymap;
 	int ispfx = 0;
 
+	if (gen != keytriegen) {
+	    /* the nodes we had may have gone while we waited for c */
+	    if (loc)
+		lpos = keytriewalk(localkeymap);
+	    kpos = keytriewalk(km);
+	    gen = keytriegen;
+	} else {
+	    if (loc)
+		lpos = keytriestep(localkeymap, lpos, c, start);
+	    kpos = keytriestep(km, kpos, c, start);
+	}
+	start = 0;
 	if (loc) {
-	    loc = ((f = keybind(localkeymap, keybuf, &s)) != t_undefinedkey);
-	    ispfx = keyisprefix(localkeymap, keybuf);
+	    if ((loc = (lpos && lpos->bind != t_undefinedkey))) {
+		f = lpos->bind;
+		s = lpos->str;
+	    }
+	    ispfx = lpos && lpos->child;
+	}
+	if (!loc && !ispfx && kpos) {
+	    f = kpos->bind;
+	    s = kpos->str;
 	}
-	if (!loc && !ispfx)
-	    f = keybind(km, keybuf, &s);
-	ispfx |= keyisprefix(km, keybuf);
+	ispfx |= kpos && kpos->child;
 
 	if (f != t_undefinedkey) {
 	    lastlen = keybuflen;
@@ -199,6 +199,477 @@ int nwatch;		/* Number of fd's we are watching */
 /**/
 Watch_fd watch_fds;
 
+#ifdef HAVE_POLL
+/*
+ * Array of pollfd structures for the terminal and the watched fds,
+ * and the number allocated.  This is kept between calls to
+ * raw_getbyte() so that waiting for a key doesn't allocate.
+ * A handler may itself read keys while the array is in use;
+ * the nested call then gets an array of its own.
+ */
+static struct pollfd *watch_pollfds;
+static int watch_pollfds_sz, watch_pollfds_busy;
+
+/*
+ * Return an array with room for nfds entries.  fds is the array
+ * already in use by the caller, or NULL on the first call.
+ */
+
+static struct pollfd *
+getwatchpollfds(struct pollfd *fds, int nfds)
+{
+    if (fds && fds != watch_pollfds)
+	return zrealloc(fds, sizeof(struct pollfd) * nfds);
+    if (!fds && watch_pollfds_busy)
+	return zalloc(sizeof(struct pollfd) * nfds);
+    watch_pollfds_busy = 1;
+    if (nfds > watch_pollfds_sz) {
+	watch_pollfds = zrealloc(watch_pollfds,
+				 sizeof(struct pollfd) * nfds);
+	watch_pollfds_sz = nfds;
+    }
+    return watch_pollfds;
+}
+
+/* Finished with an array returned by getwatchpollfds(). */
+
+static void
+putwatchpollfds(struct pollfd *fds, int nfds)
+{
+    if (fds == watch_pollfds)
+	watch_pollfds_busy = 0;
+    else
+	zfree(fds, sizeof(struct pollfd) * nfds);
+}
+#endif
+
+/*
+ * Timers to run while waiting for input, in order of expiry, and
+ * child processes whose exit we are waiting for.
+ */
+
+/**/
+Zle_event zle_timers;
+
+/**/
+Zle_event zle_children;
+
+/* Number of the last timer added from C */
+static int lastzletimer;
+
+/*
+ * Pipe poked by the SIGCHLD handler while there are children in
+ * zle_children, so that one exiting wakes us from waiting for input.
+ */
+static int chldpipe[2] = { -1, -1 };
+
+/* The time in milliseconds, for timers */
+
+/**/
+zlong
+zletimenow(void)
+{
+    struct timeval now;
+    struct timezone dummy_tz;
+
+    gettimeofday(&now, &dummy_tz);
+    return (zlong)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+/* Add an event to the list in order of when it is due and return it. */
+
+static Zle_event
+newzleevent(Zle_event *listp, int id, zlong when)
+{
+    Zle_event ev = (Zle_event)zshcalloc(sizeof(struct zle_event));
+
+    ev->id = id;
+    ev->when = when;
+    while (*listp && (*listp)->when <= when)
+	listp = &(*listp)->next;
+    ev->next = *listp;
+    *listp = ev;
+    return ev;
+}
+
+/* Remove an event from the list and free it. */
+
+static void
+freezleevent(Zle_event *listp, Zle_event ev)
+{
+    while (*listp != ev)
+	listp = &(*listp)->next;
+    *listp = ev->next;
+    zsfree(ev->func);
+    zfree(ev, sizeof(struct zle_event));
+}
+
+/*
+ * Find an event in the list: with a shell handler if cfunc is 0,
+ * identified by func if that is given, else with a C handler
+ * identified by id.
+ */
+
+/**/
+Zle_event
+findzleevent(Zle_event ev, char *func, int id, int cfunc)
+{
+    for (; ev; ev = ev->next) {
+	if (!ev->cfunc != !cfunc)
+	    continue;
+	if (func ? !strcmp(ev->func, func) : ev->id == id)
+	    return ev;
+    }
+    return NULL;
+}
+
+/*
+ * Call the shell handler for a timer or child.  arg and arg2 are
+ * passed if not NULL; a widget only gets arg.
+ */
+
+static void
+callzleevent(char *func, int widget, char *arg, char *arg2)
+{
+    if (widget)
+	zlecallhook(func, arg);
+    else {
+	LinkList funcargs = znewlinklist();
+	zaddlinknode(funcargs, ztrdup(func));
+	if (arg)
+	    zaddlinknode(funcargs, ztrdup(arg));
+	if (arg2)
+	    zaddlinknode(funcargs, ztrdup(arg2));
+	callhookfunc(func, funcargs, 0, NULL);
+	freelinklist(funcargs, freestr);
+    }
+    /* No sensible way of handling errors here */
+    errflag &= ~ERRFLAG_ERROR;
+}
+
+/*
+ * Run the timers that are due.  Return the number of milliseconds
+ * until the next one, or -1 if there are none left.
+ */
+
+static zlong
+runzletimers(void)
+{
+    while (zle_timers) {
+	Zle_event ev = zle_timers;
+	zlong now = zletimenow();
+
+	if (ev->when > now)
+	    return ev->when - now;
+	/*
+	 * Timers only go off once; take this one off the list
+	 * before running it, so the handler can add it again.
+	 */
+	zle_timers = ev->next;
+	if (ev->cfunc)
+	    ev->cfunc(ev->id, 0, ev->data);
+	else
+	    callzleevent(ev->func, ev->widget, NULL, NULL);
+	zsfree(ev->func);
+	zfree(ev, sizeof(struct zle_event));
+    }
+    return -1;
+}
+
+/*
+ * Add a watch on fd for a handler in C.  The handler is called with
+ * the fd when there is input.  Note the fd may also be watched by a
+ * shell handler from zle -F; the two are independent.
+ */
+
+/**/
+mod_export void
+addzlewatch(int fd, ZleEventFunc func, void *data)
+{
+    Watch_fd watch_fd;
+
+    watch_fds = (Watch_fd)zrealloc(watch_fds,
+				   (nwatch + 1) * sizeof(struct watch_fd));
+    watch_fd = watch_fds + nwatch++;
+    watch_fd->func = NULL;
+    watch_fd->fd = fd;
+    watch_fd->widget = 0;
+    watch_fd->cfunc = func;
+    watch_fd->data = data;
+}
+
+/* Remove the i'th entry from watch_fds. */
+
+/**/
+void
+remzlewatch(int i)
+{
+    int newnwatch = nwatch - 1;
+    Watch_fd new_fds;
+
+    zsfree(watch_fds[i].func);
+    if (newnwatch) {
+	new_fds = zalloc(newnwatch * sizeof(struct watch_fd));
+	if (i)
+	    memcpy(new_fds, watch_fds, i * sizeof(struct watch_fd));
+	if (i < newnwatch)
+	    memcpy(new_fds + i, watch_fds + i + 1,
+		   (newnwatch - i) * sizeof(struct watch_fd));
+    } else
+	new_fds = NULL;
+    zfree(watch_fds, nwatch * sizeof(struct watch_fd));
+    watch_fds = new_fds;
+    nwatch = newnwatch;
+}
+
+/* Remove a watch added by addzlewatch().  Return 1 if there was none. */
+
+/**/
+mod_export int
+delzlewatch(int fd, ZleEventFunc func)
+{
+    int i;
+
+    for (i = 0; i < nwatch; i++) {
+	if (watch_fds[i].fd == fd && watch_fds[i].cfunc == func) {
+	    remzlewatch(i);
+	    return 0;
+	}
+    }
+    return 1;
+}
+
+/*
+ * Add a timer for a handler in C, due in ms milliseconds.  It goes
+ * off once, while zle is waiting for input, and the handler is called
+ * with the number returned here.
+ */
+
+/**/
+mod_export int
+addzletimer(zlong ms, ZleEventFunc func, void *data)
+{
+    Zle_event ev;
+
+    if (++lastzletimer <= 0)
+	lastzletimer = 1;
+    ev = newzleevent(&zle_timers, lastzletimer, zletimenow() + ms);
+    ev->cfunc = func;
+    ev->data = data;
+    return lastzletimer;
+}
+
+/* Remove a timer added by addzletimer().  Return 1 if there was none. */
+
+/**/
+mod_export int
+delzletimer(int id)
+{
+    Zle_event ev = findzleevent(zle_timers, NULL, id, 1);
+
+    if (!ev)
+	return 1;
+    freezleevent(&zle_timers, ev);
+    return 0;
+}
+
+/*
+ * Add or replace the shell handler for a timer due in ms
+ * milliseconds; shell timers are identified by the handler.
+ */
+
+/**/
+void
+setzletimer(char *func, int widget, zlong ms)
+{
+    Zle_event ev = findzleevent(zle_timers, func, 0, 0);
+
+    if (ev)
+	freezleevent(&zle_timers, ev);
+    ev = newzleevent(&zle_timers, 0, zletimenow() + ms);
+    ev->func = ztrdup(func);
+    ev->widget = widget;
+}
+
+/* Remove the shell timer for func.  Return 1 if there was none. */
+
+/**/
+int
+unsetzletimer(char *func)
+{
+    Zle_event ev = findzleevent(zle_timers, func, 0, 0);
+
+    if (!ev)
+	return 1;
+    freezleevent(&zle_timers, ev);
+    return 0;
+}
+
+/*
+ * Run the handlers for children that have finished.  Each is only
+ * run once; if we can no longer find out how the child finished,
+ * perhaps because wait has already reported it, the status is 127
+ * as wait would give.
+ */
+
+static void
+runzlechildren(void)
+{
+    Zle_event ev = zle_children;
+
+    while (ev) {
+	char *func, buf[DIGBUFSIZE], buf2[DIGBUFSIZE];
+	int status, widget, pid;
+	ZleEventFunc cfunc;
+	void *data;
+
+	queue_signals();
+	status = childstatus(ev->id);
+	unqueue_signals();
+	if (status == -1) {
+	    ev = ev->next;
+	    continue;
+	}
+	if (status == -2)
+	    status = 127;
+	func = ev->func;
+	ev->func = NULL;
+	widget = ev->widget;
+	pid = ev->id;
+	cfunc = ev->cfunc;
+	data = ev->data;
+	freezlechild(ev);
+	if (cfunc)
+	    cfunc(pid, status, data);
+	else {
+	    sprintf(buf, "%d", pid);
+	    sprintf(buf2, "%d", status);
+	    callzleevent(func, widget, buf, buf2);
+	    zsfree(func);
+	}
+	/* The handler may have changed the list */
+	ev = zle_children;
+    }
+}
+
+/* Handler for the read end of chldpipe. */
+
+static void
+zlechildwake(int fd, UNUSED(int err), UNUSED(void *data))
+{
+    char buf[64];
+
+    while (read(fd, buf, sizeof(buf)) > 0)
+	;
+    runzlechildren();
+}
+
+/*
+ * Start waiting for child pid to exit.  Return NULL, with errno set,
+ * if it isn't a child of ours or we couldn't make the pipe to hear
+ * about it.
+ */
+
+static Zle_event
+newzlechild(pid_t pid)
+{
+    int status, i;
+
+    queue_signals();
+    status = childstatus(pid);
+    unqueue_signals();
+    if (status == -2) {
+	errno = ECHILD;
+	return NULL;
+    }
+    if (chldpipe[0] < 0) {
+	if (pipe(chldpipe) < 0)
+	    return NULL;
+	for (i = 0; i < 2; i++) {
+	    chldpipe[i] = movefd(chldpipe[i]);
+	    fcntl(chldpipe[i], F_SETFL, O_NONBLOCK);
+#ifdef FD_CLOEXEC
+	    fcntl(chldpipe[i], F_SETFD, FD_CLOEXEC);
+#endif
+	}
+	addzlewatch(chldpipe[0], zlechildwake, NULL);
+	chldwakefd = chldpipe[1];
+    }
+    /* It may have finished already; make sure we look. */
+    if (status != -1 && write(chldpipe[1], "", 1) < 0) {
+	/* The pipe is full, so we will look anyway */
+    }
+    return newzleevent(&zle_children, pid, 0);
+}
+
+/* Stop waiting for a child; close the pipe when there are none left. */
+
+/**/
+void
+freezlechild(Zle_event ev)
+{
+    freezleevent(&zle_children, ev);
+    if (!zle_children && chldpipe[0] >= 0) {
+	chldwakefd = -1;
+	delzlewatch(chldpipe[0], zlechildwake);
+	zclose(chldpipe[0]);
+	zclose(chldpipe[1]);
+	chldpipe[0] = chldpipe[1] = -1;
+    }
+}
+
+/*
+ * Add a handler in C for child pid exiting, called with the pid and
+ * the exit status while zle is waiting for input.  Return 1, with
+ * errno set, if pid isn't a child of the shell.
+ */
+
+/**/
+mod_export int
+addzlechild(pid_t pid, ZleEventFunc func, void *data)
+{
+    Zle_event ev = newzlechild(pid);
+
+    if (!ev)
+	return 1;
+    ev->cfunc = func;
+    ev->data = data;
+    return 0;
+}
+
+/* Remove a handler added by addzlechild().  Return 1 if there was none. */
+
+/**/
+mod_export int
+delzlechild(pid_t pid)
+{
+    Zle_event ev = findzleevent(zle_children, NULL, pid, 1);
+
+    if (!ev)
+	return 1;
+    freezlechild(ev);
+    return 0;
+}
+
+/*
+ * Add or replace the shell handler for child pid exiting.  Return 1,
+ * with errno set, if that isn't possible.
+ */
+
+/**/
+int
+setzlechild(pid_t pid, char *func, int widget)
+{
+    Zle_event ev = findzleevent(zle_children, NULL, pid, 0);
+
+    if (!ev && !(ev = newzlechild(pid)))
+	return 1;
+    zsfree(ev->func);
+    ev->func = ztrdup(func);
+    ev->widget = widget;
+    return 0;
+}
+
 /* set up terminal */
 
 /**/
@@ -405,6 +876,11 @@ enum ztmouttp {
      * the time and then continue processing.
      */
     ZTM_FUNC,
+    /*
+     * Timeout for the first of zle_timers.  If this goes off we
+     * run any timers that are due and continue processing.
+     */
+    ZTM_TIMER,
     /*
      * Timeout hit the maximum allowed; if it fires we
      * need to recalculate.  As we may use poll() for the timeout,
@@ -494,6 +970,27 @@ calc_timeout(struct ztmout *tmoutp, long do_keytmout)
 	if (resetneeded)
 	    zrefresh();
     }
+
+    if (zle_timers) {
+	zlong diff = runzletimers();
+
+	if (diff >= 0) {
+	    /* Round up so we don't wake before the timer is due */
+	    zlong exp100ths = (diff + 9) / 10;
+	    if (exp100ths > (zlong)ZMAXTIMEOUT * 100) {
+		if (tmoutp->tp == ZTM_NONE) {
+		    tmoutp->exp100ths = ZMAXTIMEOUT * 100;
+		    tmoutp->tp = ZTM_MAX;
+		}
+	    } else if (tmoutp->tp == ZTM_NONE ||
+		       exp100ths < tmoutp->exp100ths) {
+		tmoutp->exp100ths = (time_t)exp100ths;
+		tmoutp->tp = ZTM_TIMER;
+	    }
+	}
+	if (resetneeded)
+	    zrefresh();
+    }
 }
 
 /* see calc_timeout for use of do_keytmout */
@@ -560,7 +1057,7 @@ raw_getbyte(long do_keytmout, char *cptr)
 # ifdef HAVE_POLL
 	nfds = 1 + nwatch;
 	/* First pollfd is SHTTY, following are the nwatch fds */
-	fds = zalloc(sizeof(struct pollfd) * nfds);
+	fds = getwatchpollfds(NULL, nfds);
 	fds[0].fd = SHTTY;
 	/*
 	 * POLLIN, POLLIN, POLLIN,
@@ -621,6 +1118,14 @@ raw_getbyte(long do_keytmout, char *cptr)
 	     */
 	    if (selret < 0 && (errflag || retflag || breaks || exit_pending))
 		break;
+	    /*
+	     * A signal such as SIGCHLD is not an error on our fds;
+	     * look again, recalculating the timeout.
+	     */
+	    if (selret < 0 && errno == EINTR) {
+		calc_timeout(&tmout, do_keytmout);
+		continue;
+	    }
 	    /*
 	     * Try to avoid errors on our special fd's from
 	     * messing up reads from the terminal.  Try first
@@ -666,6 +1171,9 @@ raw_getbyte(long do_keytmout, char *cptr)
 			zrefresh();
 		    /* We need to recalculate the timeout */
 		    /*FALLTHROUGH*/
+		case ZTM_TIMER:
+		    /* calc_timeout() runs the timers that are due */
+		    /*FALLTHROUGH*/
 		case ZTM_MAX:
 		    /*
 		     * Reached the limit of our range, but not the
@@ -724,6 +1232,29 @@ raw_getbyte(long do_keytmout, char *cptr)
 			) {
 			/* Handle the fd. */
 			char *fdbuf;
+			if (lwatch_fd->cfunc) {
+			    int j, err;
+# ifdef HAVE_POLL
+			    err = fds[i+1].revents & (POLLERR|POLLHUP|POLLNVAL);
+# else
+			    err = FD_ISSET(lwatch_fd->fd, &errfd);
+# endif
+			    /*
+			     * Only if it's still there: an earlier
+			     * handler may have removed it and freed
+			     * the data.
+			     */
+			    for (j = 0; j < nwatch; j++) {
+				if (watch_fds[j].fd == lwatch_fd->fd &&
+				    watch_fds[j].cfunc == lwatch_fd->cfunc &&
+				    watch_fds[j].data == lwatch_fd->data) {
+				    lwatch_fd->cfunc(lwatch_fd->fd, err,
+						     lwatch_fd->data);
+				    break;
+				}
+			    }
+			    continue;
+			}
 			{
 			    char buf[BDIGBUFSIZE];
 			    convbase(buf, lwatch_fd->fd, 10);
@@ -779,7 +1310,7 @@ raw_getbyte(long do_keytmout, char *cptr)
 		/* Function may have added or removed handlers */
 		nfds = 1 + nwatch;
 		if (nfds > 1) {
-		    fds = zrealloc(fds, sizeof(struct pollfd) * nfds);
+		    fds = getwatchpollfds(fds, nfds);
 		    for (i = 0; i < nwatch; i++) {
 			/*
 			 * This is imperfect because it assumes fds[] and
@@ -802,7 +1333,7 @@ raw_getbyte(long do_keytmout, char *cptr)
 	    }
 	}
 # ifdef HAVE_POLL
-	zfree(fds, sizeof(struct pollfd) * nfds);
+	putwatchpollfds(fds, nfds);
 # endif
 	if (selret < 0)
 	    return selret;
@@ -937,6 +1468,73 @@ getbyte(long do_keytmout, int *timeout)
 }
 
 
+/*
+ * Read up to len bytes into buf in one go, for callers such as
+ * bracketed paste that consume large amounts of input without
+ * interpreting it as keys.  Bytes pushed back with ungetbyte() are
+ * returned first.  Otherwise we wait for a byte as getbyte() does,
+ * then take whatever else the terminal already has available with a
+ * single read() rather than a system call per byte.  Returns the
+ * number of bytes read, 0 on timeout or interrupt.
+ */
+
+/**/
+mod_export int
+getbytes(char *buf, int len, long do_keytmout)
+{
+    int ret = 0, c;
+#ifdef FIONREAD
+    int val = 0, i;
+#endif
+
+    if (kungetct) {
+	while (kungetct && ret < len)
+	    buf[ret++] = kungetbuf[--kungetct];
+	if (vichgflag) {
+	    while (curvichg.bufptr + ret > curvichg.bufsz)
+		curvichg.buf = realloc(curvichg.buf, curvichg.bufsz *= 2);
+	    memcpy(curvichg.buf + curvichg.bufptr, buf, ret);
+	    curvichg.bufptr += ret;
+	}
+	return ret;
+    }
+
+    if ((c = getbyte(do_keytmout, NULL)) == EOF)
+	return 0;
+    buf[ret++] = c;
+
+#ifdef FIONREAD
+    if (ret < len && ioctl(SHTTY, FIONREAD, (char *)&val) == 0 && val > 0) {
+	int old_errno = errno;
+
+	if (val > len - ret)
+	    val = len - ret;
+	if ((val = read(SHTTY, buf + ret, val)) > 0) {
+	    /* the same exchange of \n and \r as in getbyte() */
+	    for (i = ret; i < ret + val; i++) {
+		if (buf[i] == '\r')
+		    buf[i] = '\n';
+		else if (buf[i] == '\n')
+		    buf[i] = '\r';
+	    }
+	    if (vichgflag) {
+		while (curvichg.bufptr + val > curvichg.bufsz)
+		    curvichg.buf = realloc(curvichg.buf, curvichg.bufsz *= 2);
+		memcpy(curvichg.buf + curvichg.bufptr, buf + ret, val);
+		curvichg.bufptr += val;
+	    }
+	    ret += val;
+	}
+	errno = old_errno;
+    }
+#endif
+#ifdef MULTIBYTE_SUPPORT
+    lastchar_wide_valid = 0;
+#endif
+    lastchar = STOUC(buf[ret - 1]);
+    return ret;
+}
+
 /*
  * Get a full character rather than just a single byte.
  */
@@ -2145,7 +2743,7 @@ zle_main_entry(int cmd, va_list ap)
 static struct builtin bintab[] = {
     BUILTIN("bindkey", 0, bin_bindkey, 0, -1, 0, "evaM:ldDANmrsLRp", NULL),
     BUILTIN("vared",   0, bin_vared,   1,  1, 0, "aAcef:hi:M:m:p:r:t:", NULL),
-    BUILTIN("zle",     0, bin_zle,     0, -1, 0, "aAcCDfFgGIKlLmMNrRTUw", NULL),
+    BUILTIN("zle",     0, bin_zle,     0, -1, 0, "aAcCDfFgGIKlLmMNprRtTUw", NULL),
 };
 
 /* The order of the entries in this table has to match the *HOOK
@@ -2268,6 +2866,16 @@ finish_(UNUSED(Module m))
 
     zfree(lastvichg.buf, lastvichg.bufsz);
     zfree(kungetbuf, kungetsz);
+#ifdef HAVE_POLL
+    zfree(watch_pollfds, watch_pollfds_sz * sizeof(struct pollfd));
+    watch_pollfds = NULL;
+    watch_pollfds_sz = watch_pollfds_busy = 0;
+    while (zle_timers)
+	freezleevent(&zle_timers, zle_timers);
+    /* This also stops the SIGCHLD handler using our pipe */
+    while (zle_children)
+	freezlechild(zle_children);
+#endif
     free_isrch_spots();
     if (rdstrs)
         freelinklist(rdstrs, freestr);
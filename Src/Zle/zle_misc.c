@@ -751,22 +751,39 @@ bracketedstring(void)
     size_t psize = 64;
     char *pbuf = zalloc(psize);
     size_t current = 0;
-    int next, timeout;
+    char inbuf[BUFSIZ];
+    int inlen, inpos;
 
-    while (endesc[endpos]) {
-	if (current + 1 >= psize)
-	    pbuf = zrealloc(pbuf, psize *= 2);
-	if ((next = getbyte(1L, &timeout)) == EOF)
-	    break;
-	if (!endpos || next != endesc[endpos++])
-	    endpos = (next == *endesc);
-	if (imeta(next)) {
-	    pbuf[current++] = Meta;
-	    pbuf[current++] = next ^ 32;
-	} else if (next == '\r')
-	    pbuf[current++] = '\n';
-	else
-	    pbuf[current++] = next;
+    /*
+     * Pastes can be large, so take input in as big chunks as the
+     * terminal will give us; anything after the closing escape
+     * sequence is pushed back for normal key processing.
+     */
+    while (endesc[endpos] && (inlen = getbytes(inbuf, BUFSIZ, 1L)) > 0) {
+	if (current + 2 * inlen >= psize) {
+	    while (current + 2 * inlen >= psize)
+		psize *= 2;
+	    pbuf = zrealloc(pbuf, psize);
+	}
+	for (inpos = 0; inpos < inlen && endesc[endpos]; inpos++) {
+	    int next = STOUC(inbuf[inpos]);
+
+	    if (!endpos || next != endesc[endpos++])
+		endpos = (next == *endesc);
+	    if (imeta(next)) {
+		pbuf[current++] = Meta;
+		pbuf[current++] = next ^ 32;
+	    } else if (next == '\r')
+		pbuf[current++] = '\n';
+	    else
+		pbuf[current++] = next;
+	}
+	if (inpos < inlen) {
+	    ungetbytes(inbuf + inpos, inlen - inpos);
+	    /* they will be recorded again when read */
+	    if (vichgflag)
+		curvichg.bufptr -= inlen - inpos;
+	}
     }
     pbuf[current-endpos] = '\0';
     return pbuf;
@@ -85,6 +85,8 @@ static const struct gsu_integer cursor_gsu =
 { get_cursor, set_cursor, zleunsetfn };
 static const struct gsu_integer histno_gsu =
 { get_histno, set_histno, zleunsetfn };
+static const struct gsu_integer keys_probe_count_gsu =
+{ get_keys_probe_count, NULL, zleunsetfn };
 static const struct gsu_integer keys_queued_count_gsu =
 { get_keys_queued_count, NULL, zleunsetfn };
 static const struct gsu_integer mark_gsu =
@@ -93,6 +95,8 @@ static const struct gsu_integer numeric_gsu =
 { get_numeric, set_numeric, unset_numeric };
 static const struct gsu_integer pending_gsu =
 { get_pending, NULL, zleunsetfn };
+static const struct gsu_integer refresh_bytes_gsu =
+{ get_refresh_bytes, NULL, zleunsetfn };
 static const struct gsu_integer region_active_gsu =
 { get_region_active, set_region_active, zleunsetfn };
 static const struct gsu_integer undo_change_no_gsu =
@@ -148,6 +152,8 @@ static struct zleparam {
     { "HISTNO", PM_INTEGER, GSU(histno_gsu), NULL },
     { "KEYMAP", PM_SCALAR | PM_READONLY, GSU(keymap_gsu), NULL },
     { "KEYS", PM_SCALAR | PM_READONLY, GSU(keys_gsu), NULL },
+    { "KEYS_PROBE_COUNT", PM_INTEGER | PM_READONLY, GSU(keys_probe_count_gsu),
+      NULL},
     { "KEYS_QUEUED_COUNT", PM_INTEGER | PM_READONLY, GSU(keys_queued_count_gsu),
       NULL},
     { "killring", PM_ARRAY, GSU(killring_gsu), NULL },
@@ -163,6 +169,8 @@ static struct zleparam {
     { "PREBUFFER",  PM_SCALAR | PM_READONLY,  GSU(prebuffer_gsu), NULL },
     { "PREDISPLAY", PM_SCALAR, GSU(predisplay_gsu), NULL },
     { "RBUFFER", PM_SCALAR,  GSU(rbuffer_gsu), NULL },
+    { "REFRESH_BYTES", PM_INTEGER | PM_READONLY, GSU(refresh_bytes_gsu),
+      NULL },
     { "REGION_ACTIVE", PM_INTEGER, GSU(region_active_gsu), NULL},
     { "region_highlight", PM_ARRAY, GSU(region_highlight_gsu), NULL },
     { "UNDO_CHANGE_NO", PM_INTEGER | PM_READONLY, GSU(undo_change_no_gsu),
@@ -461,6 +469,13 @@ get_keys(UNUSED(Param pm))
     return keybuf;
 }
 
+/**/
+static zlong
+get_keys_probe_count(UNUSED(Param pm))
+{
+    return keyprobes;
+}
+
 /**/
 static zlong
 get_keys_queued_count(UNUSED(Param pm))
@@ -526,6 +541,13 @@ get_pending(UNUSED(Param pm))
     return noquery(0);
 }
 
+/**/
+static zlong
+get_refresh_bytes(UNUSED(Param pm))
+{
+    return refreshbytes;
+}
+
 /**/
 static zlong
 get_yankstart(UNUSED(Param pm))
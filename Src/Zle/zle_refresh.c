@@ -239,6 +239,13 @@ int region_active;
 /**/
 char *tcout_func_name;
 
+/*
+ * Number of bytes sent to the terminal by the last redisplay,
+ * made available to widgets as $REFRESH_BYTES.
+ */
+/**/
+zlong refreshbytes;
+
 #ifdef HAVE_SELECT
 /* cost of last update */
 /**/
@@ -602,16 +609,21 @@ zwcputc(const REFRESH_ELEMENT *c, int *curatrp)
 
 	memset(&mbstate, 0, sizeof(mbstate_t));
 	while (nchars--) {
-	    if ((i = wcrtomb(mbtmp, (wchar_t)*wcptr++, &mbstate)) > 0)
+	    if ((i = wcrtomb(mbtmp, (wchar_t)*wcptr++, &mbstate)) > 0) {
 		fwrite(mbtmp, i, 1, shout);
+		shoutbytes += i;
+	    }
 	}
     } else if (c->chr != WEOF) {
 	memset(&mbstate, 0, sizeof(mbstate_t));
-	if ((i = wcrtomb(mbtmp, (wchar_t)c->chr, &mbstate)) > 0)
+	if ((i = wcrtomb(mbtmp, (wchar_t)c->chr, &mbstate)) > 0) {
 	    fwrite(mbtmp, i, 1, shout);
+	    shoutbytes += i;
+	}
     }
 #else
     fputc(c->chr, shout);
+    shoutbytes++;
 #endif
 
     /*
@@ -634,6 +646,18 @@ zwcputc(const REFRESH_ELEMENT *c, int *curatrp)
     }
 }
 
+/*
+ * Output a metafied string such as a prompt, keeping count of
+ * the bytes sent.
+ */
+
+static void
+zr_puts(char *s)
+{
+    zputs(s, shout);
+    shoutbytes += ztrlen(s);
+}
+
 static int
 zwcwrite(const REFRESH_STRING s, size_t i)
 {
@@ -668,6 +692,30 @@ static int more_start,		/* more text before start of screen?	    */
     winprompt,			/* singlelinezle: part of lprompt showing   */
     winw_alloc = -1,		/* allocated window width */
     winh_alloc = -1;		/* allocates window height */
+
+/*
+ * Damage tracking.  For each line of the video buffer built by the
+ * last refresh we remember the offset into the displayed text at
+ * which it started.  If nothing before the start of line k has changed
+ * since, lines 0 to k-1 are copied from the old video buffer and the
+ * new one is only built from line k on.  This matters for long
+ * buffers, where otherwise each keystroke reformats every line.
+ */
+static struct rowstate {
+    int start;			/* offset into text, -1 if mid-character */
+    int canscroll;		/* rparams.canscroll at start of line */
+    int numscrolls;		/* numscrolls at start of line */
+#ifdef MULTIBYTE_SUPPORT
+    int mwind;			/* nmw_ind at start of line */
+#endif
+} *rowstates;
+static int rowsvalid,		/* rowstates usable by next refresh	    */
+    orowlnct,			/* lines of text when they were recorded    */
+    ohlstart,			/* first highlighted offset at that time    */
+    odefault_atr_on, ospecial_atr_on, olpromptw;
+static ZLE_STRING_T rowtext;	/* copy of text when they were recorded	    */
+static int rowtextsz, rowtextll;
+
 #ifdef MULTIBYTE_SUPPORT
 static int
     omw_size,			/* allocated size of omwbuf */
@@ -691,6 +739,8 @@ freevideo(void)
 	}
 	free(nbuf);
 	free(obuf);
+	zfree(rowstates, (winh_alloc + 1) * sizeof(*rowstates));
+	rowstates = NULL;
 #ifdef MULTIBYTE_SUPPORT
 	zfree(nmwbuf, nmw_size * sizeof(*nmwbuf));
 	zfree(omwbuf, omw_size * sizeof(*omwbuf));
@@ -724,6 +774,8 @@ resetvideo(void)
 	obuf = (REFRESH_STRING *)zshcalloc((winh + 1) * sizeof(*obuf));
 	nbuf[0] = (REFRESH_STRING)zalloc((winw + 2) * sizeof(**nbuf));
 	obuf[0] = (REFRESH_STRING)zalloc((winw + 2) * sizeof(**obuf));
+	rowstates = (struct rowstate *)
+	    zalloc((winh + 1) * sizeof(*rowstates));
 
 #ifdef MULTIBYTE_SUPPORT
 	nmw_size = DEF_MWBUF_ALLOC;
@@ -768,6 +820,7 @@ resetvideo(void)
 
     vcs = lpromptw;
     olnct = nlnct = 0;
+    rowsvalid = 0;
     if (showinglist > 0)
 	showinglist = -2;
     trashedzle = 0;
@@ -785,9 +838,12 @@ scrollwindow(int tline)
     REFRESH_STRING s;
 
     s = nbuf[tline];
-    for (t0 = tline; t0 < winh - 1; t0++)
+    for (t0 = tline; t0 < winh - 1; t0++) {
 	nbuf[t0] = nbuf[t0 + 1];
+	rowstates[t0] = rowstates[t0 + 1];
+    }
     nbuf[winh - 1] = s;
+    rowstates[winh - 1].start = -1;
     if (!tline)
 	more_start = 1;
     return;
@@ -976,6 +1032,124 @@ bufswap(void)
 #endif
 }
 
+/*
+ * Offset into the displayed text of the first character that
+ * has some region highlighting applied, or tmpll if none does.
+ */
+
+static int
+firsthighlight(int tmpll)
+{
+    struct region_highlight *rhp;
+    int first = tmpll;
+
+    for (rhp = region_highlights;
+	 rhp < region_highlights + n_region_highlights;
+	 rhp++) {
+	int offset = (rhp->flags & ZRH_PREDISPLAY) ? 0 : predisplaylen;
+	if (rhp->start < rhp->end && rhp->start + offset < first)
+	    first = rhp->start + offset;
+    }
+    return first < 0 ? 0 : first;
+}
+
+/*
+ * See if the lines of the video buffer at the start of the display
+ * are unchanged since the last refresh.  If so, copy them into the
+ * new buffer and return the first line that needs building, with
+ * the state needed to continue from there set in rpms.  Otherwise
+ * return 0.
+ *
+ * hlstart is the first offset with highlighting; the attributes of
+ * everything before it are plain, and everything before tmpcs is
+ * to the left of the cursor, so we needn't look for it.
+ */
+
+static int
+reuselines(ZLE_STRING_T tmpline, int tmpll, int tmpcs, int hlstart,
+	   Rparams rpms)
+{
+    int limit, ln;
+
+    if (!rowsvalid || lpromptw != olpromptw ||
+	default_atr_on != odefault_atr_on ||
+	special_atr_on != ospecial_atr_on)
+	return 0;
+
+    limit = tmpcs;
+    if (zledamage >= 0 && zledamage + predisplaylen < limit)
+	limit = zledamage + predisplaylen;
+    if (hlstart < limit)
+	limit = hlstart;
+    if (ohlstart < limit)
+	limit = ohlstart;
+
+    for (ln = orowlnct - 1; ln > 0; ln--)
+	if (rowstates[ln].start >= 0 && rowstates[ln].start <= limit)
+	    break;
+    if (ln <= 0)
+	return 0;
+
+    limit = rowstates[ln].start;
+    /*
+     * The damage record is only a hint, so check the text really
+     * is the same up to here.  A combining character where the line
+     * used to start would join the previous line.
+     */
+    if (limit > tmpll || limit > rowtextll ||
+	ZS_memcmp(tmpline, rowtext, limit))
+	return 0;
+#ifdef MULTIBYTE_SUPPORT
+    if (limit < tmpll && isset(COMBININGCHARS) && IS_COMBINING(tmpline[limit]))
+	return 0;
+    if (rowstates[ln].mwind > nmw_size) {
+	nmwbuf = (REFRESH_CHAR *)zrealloc(nmwbuf, rowstates[ln].mwind *
+					  sizeof(*nmwbuf));
+	nmw_size = rowstates[ln].mwind;
+    }
+    memcpy(nmwbuf, omwbuf, rowstates[ln].mwind * sizeof(*nmwbuf));
+    nmw_ind = rowstates[ln].mwind;
+#endif
+
+    for (limit = 0; limit <= ln; limit++) {
+	if (!nbuf[limit])
+	    nbuf[limit] = (REFRESH_STRING)zalloc((winw + 2) * sizeof(**nbuf));
+	if (limit < ln)
+	    ZR_memcpy(nbuf[limit], obuf[limit], winw + 2);
+    }
+
+    rpms->ln = ln;
+    rpms->s = nbuf[ln];
+    rpms->sen = rpms->s + winw;
+    rpms->canscroll = rowstates[ln].canscroll;
+    if ((numscrolls = rowstates[ln].numscrolls))
+	more_start = 1;
+    return ln;
+}
+
+/*
+ * Remember the text and state that produced the current video
+ * buffer so that the next refresh can reuse lines of it.
+ */
+
+static void
+savelines(ZLE_STRING_T tmpline, int tmpll, int hlstart)
+{
+    if (tmpll > rowtextsz) {
+	zfree(rowtext, rowtextsz * sizeof(*rowtext));
+	rowtextsz = tmpll + 256;
+	rowtext = (ZLE_STRING_T)zalloc(rowtextsz * sizeof(*rowtext));
+    }
+    if (tmpll)
+	ZS_memcpy(rowtext, tmpline, tmpll);
+    rowtextll = tmpll;
+    orowlnct = nlnct;
+    ohlstart = hlstart;
+    odefault_atr_on = default_atr_on;
+    ospecial_atr_on = special_atr_on;
+    olpromptw = lpromptw;
+}
+
 
 /**/
 mod_export void
@@ -994,6 +1168,8 @@ zrefresh(void)
     int remetafy;		/* flag that zle line is metafied	     */
     int txtchange;		/* attributes set after prompts              */
     int rprompt_off = 1;	/* Offset of rprompt from right of screen    */
+    int hlstart;		/* first highlighted position in tmpline     */
+    zlong startbytes = shoutbytes;
     struct rparams rpms;
 #ifdef MULTIBYTE_SUPPORT
     int width;			/* width of wide character		     */
@@ -1164,9 +1340,9 @@ zrefresh(void)
         if (termflags & TERM_SHORT)
             vcs = 0;
 	else if (!clearflag && lpromptbuf[0]) {
-            zputs(lpromptbuf, shout);
+            zr_puts(lpromptbuf);
 	    if (lpromptwof == winw)
-		zputs("\n", shout);	/* works with both hasam and !hasam */
+		zr_puts("\n");	/* works with both hasam and !hasam */
 	} else {
 	    txtchange = pmpt_attr;
 	    settextattributes(txtchange);
@@ -1176,7 +1352,6 @@ zrefresh(void)
 	    vcs = 0;
 	    moveto(0, lpromptw);
 	}
-	fflush(shout);
 	clearf = clearflag;
     } else if (winw != zterm_columns || rwinh != zterm_lines)
 	resetvideo();
@@ -1186,6 +1361,7 @@ zrefresh(void)
 
     if (termflags & TERM_SHORT) {
 	singlerefresh(tmpline, tmpll, tmpcs);
+	rowsvalid = 0;
 	goto singlelineout;
     }
 
@@ -1209,12 +1385,37 @@ zrefresh(void)
     memset(&rpms, 0, sizeof(rpms));
     rpms.nvln = -1;
 
-    rpms.s = nbuf[rpms.ln = 0] + lpromptw;
-    rpms.sen = *nbuf + winw;
-    for (t = tmpline, tmppos = 0; tmppos < tmpll; t++, tmppos++) {
+    hlstart = firsthighlight(tmpll);
+    if ((iln = reuselines(tmpline, tmpll, tmpcs, hlstart, &rpms))) {
+	tmppos = rowstates[iln].start;
+    } else {
+	rpms.s = nbuf[rpms.ln = 0] + lpromptw;
+	rpms.sen = *nbuf + winw;
+	tmppos = 0;
+	rowstates[0].start = 0;
+	rowstates[0].canscroll = rowstates[0].numscrolls = 0;
+#ifdef MULTIBYTE_SUPPORT
+	rowstates[0].mwind = nmw_ind;
+#endif
+    }
+    for (iln++; iln < winh; iln++)
+	rowstates[iln].start = -1;
+    zledamage = -1;
+
+    for (t = tmpline + tmppos; tmppos < tmpll; t++, tmppos++) {
 	int base_atr_on = default_atr_on, base_atr_off = 0, ireg;
 	int all_atr_on, all_atr_off;
 	struct region_highlight *rhp;
+
+	if (rpms.s == nbuf[rpms.ln] && rowstates[rpms.ln].start < 0) {
+	    /* first character on a fresh line: remember how we got here */
+	    rowstates[rpms.ln].start = tmppos;
+	    rowstates[rpms.ln].canscroll = rpms.canscroll;
+	    rowstates[rpms.ln].numscrolls = numscrolls;
+#ifdef MULTIBYTE_SUPPORT
+	    rowstates[rpms.ln].mwind = nmw_ind;
+#endif
+	}
 	/*
 	 * Calculate attribute based on region.
 	 */
@@ -1675,7 +1876,7 @@ zrefresh(void)
 	    int attrchange;
 
 	    moveto(0, winw - rprompt_off - rpromptw);
-	    zputs(rpromptbuf, shout);
+	    zr_puts(rpromptbuf);
 	    vcs = winw - rprompt_off;
 	/* reset character attributes to that set by the main prompt */
 	    txtchange = pmpt_attr;
@@ -1742,7 +1943,14 @@ individually */
     onumscrolls = numscrolls;
     if (nlnct > vmaxln)
 	vmaxln = nlnct;
+    /*
+     * Lines can be reused unless something was added to the
+     * display after the text was laid out.
+     */
+    if ((rowsvalid = !more_end && !statusline))
+	savelines(tmpline, tmpll, hlstart);
 singlelineout:
+    refreshbytes = shoutbytes - startbytes;
     fflush(shout);		/* make sure everything is written out */
 
     if (tmpalloced)
@@ -2282,9 +2490,10 @@ tc_rightcurs(int ct)
    */
     if (vln == 0 && i < lpromptw && !(termflags & TERM_SHORT)) {
 #ifndef MULTIBYTE_SUPPORT
-	if ((int)strlen(lpromptbuf) == lpromptw)
+	if ((int)strlen(lpromptbuf) == lpromptw) {
 	    fputs(lpromptbuf + i, shout);
-	else 
+	    shoutbytes += lpromptw - i;
+	} else 
 #endif
 	if (tccan(TCRIGHT) && (tclen[TCRIGHT] * ct <= ztrlen(lpromptbuf)))
 	    /* it is cheaper to send TCRIGHT than reprint the whole prompt */
@@ -2294,9 +2503,9 @@ tc_rightcurs(int ct)
 	    if (i != 0)
 		zputc(&zr_cr);
 	    tc_upcurs(lprompth - 1);
-	    zputs(lpromptbuf, shout);
+	    zr_puts(lpromptbuf);
 	    if (lpromptwof == winw)
-		zputs("\n", shout);	/* works with both hasam and !hasam */
+		zr_puts("\n");	/* works with both hasam and !hasam */
 	}
 	i = lpromptw;
 	ct = cl - i;
@@ -2697,6 +2906,7 @@ singlerefresh(ZLE_STRING_T tmpline, int tmpll, int tmpcs)
 			    } else {
 				fputc(*pptr, shout);
 			    }
+			shoutbytes++;
 			pptr++;
 			mblen--;
 		    }
@@ -2792,6 +3002,12 @@ zle_refresh_finish(void)
 {
     freevideo();
 
+    if (rowtext) {
+	zfree(rowtext, rowtextsz * sizeof(*rowtext));
+	rowtext = NULL;
+	rowtextsz = rowtextll = 0;
+    }
+
     if (region_highlights)
     {
 	zfree(region_highlights,
@@ -835,6 +835,103 @@ bin_zle_invalidate(UNUSED(char *name), UNUSED(char **args), UNUSED(Options ops),
 	return 1;
 }
 
+/*
+ * List the shell handlers for timers or children in the form of
+ * zle -F commands; only the one for func or id if that is given.
+ * Return 1 if that wasn't found.
+ */
+
+static int
+listzleevents(char *name, Zle_event ev, char *func, int id, int timer)
+{
+    int found = 0;
+
+    for (; ev; ev = ev->next) {
+	if (ev->cfunc || (func && strcmp(ev->func, func)) ||
+	    (id && ev->id != id))
+	    continue;
+	found = 1;
+	if (timer) {
+	    zlong ms = ev->when - zletimenow();
+	    printf("%s -F %s-t %ld %s\n", name, ev->widget ? "-w " : "",
+		   (long)(ms < 0 ? 0 : ms), ev->func);
+	} else
+	    printf("%s -F %s-p %d %s\n", name, ev->widget ? "-w " : "",
+		   ev->id, ev->func);
+    }
+    return (func || id) && !found;
+}
+
+/* zle -F -t: timers */
+
+static int
+bin_zle_timer(char *name, char **args, Options ops)
+{
+    zlong ms;
+    char *endptr;
+
+    if (OPT_ISSET(ops,'L') || !*args) {
+	if (*args && args[1]) {
+	    zwarnnam(name, "too many arguments for -FL");
+	    return 1;
+	}
+	return listzleevents(name, zle_timers, *args, 0, 1);
+    }
+
+    if (args[1]) {
+	ms = zstrtol(*args, &endptr, 10);
+	if (*endptr || ms < 0) {
+	    zwarnnam(name, "Bad number of milliseconds for -t: %s", *args);
+	    return 1;
+	}
+	setzletimer(args[1], OPT_ISSET(ops,'w') ? 1 : 0, ms);
+    } else if (unsetzletimer(*args)) {
+	zwarnnam(name, "No timer set for %s", *args);
+	return 1;
+    }
+    return 0;
+}
+
+/* zle -F -p: children */
+
+static int
+bin_zle_child(char *name, char **args, Options ops)
+{
+    pid_t pid = 0;
+    char *endptr;
+
+    if (*args) {
+	pid = (pid_t)zstrtol(*args, &endptr, 10);
+	if (*endptr || pid <= 0) {
+	    zwarnnam(name, "Bad process ID for -p: %s", *args);
+	    return 1;
+	}
+    }
+
+    if (OPT_ISSET(ops,'L') || !*args) {
+	if (*args && args[1]) {
+	    zwarnnam(name, "too many arguments for -FL");
+	    return 1;
+	}
+	return listzleevents(name, zle_children, NULL, pid, 0);
+    }
+
+    if (args[1]) {
+	if (setzlechild(pid, args[1], OPT_ISSET(ops,'w') ? 1 : 0)) {
+	    zwarnnam(name, "can't wait for process %d: %e", (int)pid, errno);
+	    return 1;
+	}
+    } else {
+	Zle_event ev = findzleevent(zle_children, NULL, pid, 0);
+	if (!ev) {
+	    zwarnnam(name, "No handler installed for process %d", (int)pid);
+	    return 1;
+	}
+	freezlechild(ev);
+    }
+    return 0;
+}
+
 /**/
 static int
 bin_zle_fd(char *name, char **args, Options ops, UNUSED(char func))
@@ -842,6 +939,15 @@ bin_zle_fd(char *name, char **args, Options ops, UNUSED(char func))
     int fd = 0, i, found = 0;
     char *endptr;
 
+    if (OPT_ISSET(ops,'t') && OPT_ISSET(ops,'p')) {
+	zwarnnam(name, "-t and -p can't be combined");
+	return 1;
+    }
+    if (OPT_ISSET(ops,'t'))
+	return bin_zle_timer(name, args, ops);
+    if (OPT_ISSET(ops,'p'))
+	return bin_zle_child(name, args, ops);
+
     if (*args) {
 	fd = (int)zstrtol(*args, &endptr, 10);
 
@@ -859,12 +965,17 @@ bin_zle_fd(char *name, char **args, Options ops, UNUSED(char func))
 	}
 	for (i = 0; i < nwatch; i++) {
 	    Watch_fd watch_fd = watch_fds + i;
-	    if (*args && watch_fd->fd != fd)
+	    /* Handlers added from C aren't ours to list */
+	    if (watch_fd->cfunc || (*args && watch_fd->fd != fd))
 		continue;
 	    found = 1;
 	    printf("%s -F %s%d %s\n", name, watch_fd->widget ? "-w " : "",
 		   watch_fd->fd, watch_fd->func);
 	}
+	if (!*args) {
+	    listzleevents(name, zle_timers, NULL, 0, 1);
+	    listzleevents(name, zle_children, NULL, 0, 0);
+	}
 	/* only return status 1 if fd given and not found */
 	return *args && !found;
     }
@@ -875,7 +986,7 @@ bin_zle_fd(char *name, char **args, Options ops, UNUSED(char func))
 	if (nwatch) {
 	    for (i = 0; i < nwatch; i++) {
 		Watch_fd watch_fd = watch_fds + i;
-		if (watch_fd->fd == fd) {
+		if (watch_fd->fd == fd && !watch_fd->cfunc) {
 		    zsfree(watch_fd->func);
 		    watch_fd->func = funcnam;
 		    watch_fd->widget = OPT_ISSET(ops,'w') ? 1 : 0;
@@ -894,32 +1005,16 @@ bin_zle_fd(char *name, char **args, Options ops, UNUSED(char func))
 	    new_fd->fd = fd;
 	    new_fd->func = funcnam;
 	    new_fd->widget = OPT_ISSET(ops,'w') ? 1 : 0;
+	    new_fd->cfunc = NULL;
+	    new_fd->data = NULL;
 	    nwatch = newnwatch;
 	}
     } else {
 	/* Deleting a handler */
 	for (i = 0; i < nwatch; i++) {
 	    Watch_fd watch_fd = watch_fds + i;
-	    if (watch_fd->fd == fd) {
-		int newnwatch = nwatch-1;
-		Watch_fd new_fds;
-
-		zsfree(watch_fd->func);
-		if (newnwatch) {
-		    new_fds = zalloc(newnwatch*sizeof(struct watch_fd));
-		    if (i) {
-			memcpy(new_fds, watch_fds, i*sizeof(struct watch_fd));
-		    }
-		    if (i < newnwatch) {
-			memcpy(new_fds+i, watch_fds+i+1,
-			       (newnwatch-i)*sizeof(struct watch_fd));
-		    }
-		} else {
-		    new_fds = NULL;
-		}
-		zfree(watch_fds, nwatch*sizeof(struct watch_fd));
-		watch_fds = new_fds;
-		nwatch = newnwatch;
+	    if (watch_fd->fd == fd && !watch_fd->cfunc) {
+		remzlewatch(i);
 		found = 1;
 		break;
 	    }
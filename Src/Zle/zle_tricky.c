@@ -437,6 +437,7 @@ checkparams(char *p)
     int t0, n, l = strlen(p), e = 0;
     struct hashnode *hn;
 
+    importallenv();
     for (t0 = paramtab->hsize - 1, n = 0; n < 2 && t0 >= 0; t0--)
 	for (hn = paramtab->nodes[t0]; n < 2 && hn; hn = hn->next)
 	    if (pfxlen(p, hn->nam) == l) {
@@ -990,6 +991,8 @@ unmetafy_line(void)
     /* paranoia */
     zlemetaline[zlemetall] = '\0';
     zleline = stringaszleline(zlemetaline, zlemetacs, &zlell, &linesz, &zlecs);
+    /* edits on the metafied line are not tracked, so assume the worst */
+    zle_damage(0);
 
     free(zlemetaline);
     zlemetaline = NULL;
@@ -60,6 +60,16 @@ int lastlinesz, lastll, lastcs;
 /**/
 int linesz;
 
+/*
+ * Lowest position in zleline altered by the editing primitives
+ * since the last redisplay, or -1 if none.  zrefresh() uses this
+ * to decide how many screen lines it can keep from last time; see
+ * zle_damage().
+ */
+
+/**/
+int zledamage;
+
 /* make sure that the line buffer has at least sz chars */
 
 /**/
@@ -91,6 +101,21 @@ sizeline(int sz)
 	linesz = cursz;
 }
 
+/*
+ * Record that the line has changed from position pos onward.
+ * This is only a hint:  widgets that alter zleline in place without
+ * going through spaceinline() or shiftchars() are caught by the
+ * check on the unchanged prefix in zrefresh().
+ */
+
+/**/
+mod_export void
+zle_damage(int pos)
+{
+    if (zledamage < 0 || pos < zledamage)
+	zledamage = pos;
+}
+
 /*
  * Insert a character, called from main shell.
  * Note this always operates on the metafied multibyte version of the
@@ -784,6 +809,7 @@ spaceinline(int ct)
 	    }
 	}
     } else {
+	zle_damage(zlecs);
 	sizeline(ct + zlell);
 	for (i = zlell; --i >= zlecs;)
 	    zleline[i + ct] = zleline[i];
@@ -862,6 +888,7 @@ shiftchars(int to, int cnt)
 	}
 	zlemetaline[zlemetall = to] = '\0';
     } else {
+	zle_damage(to);
 	/* before to is updated... */
 	if (region_highlights) {
 	    for (rhp = region_highlights + N_SPECIAL_HIGHLIGHTS;
@@ -1115,6 +1142,7 @@ setline(char *s, int flags)
     free(zleline);
 
     viinsbegin = 0;
+    zle_damage(0);
     zleline = stringaszleline(scp, 0, &zlell, &linesz, NULL);
 
     if ((flags & ZSL_TOEND) && (zlecs = zlell) && invicmdmode())
@@ -105,7 +105,7 @@ static struct builtin builtins[] =
     BUILTIN("pushln", 0, bin_print, 0, -1, BIN_PRINT, NULL, "-nz"),
     BUILTIN("pwd", 0, bin_pwd, 0, 0, 0, "rLP", NULL),
     BUILTIN("r", 0, bin_fc, 0, -1, BIN_R, "IlLnr", NULL),
-    BUILTIN("read", 0, bin_read, 0, -1, 0, "cd:ek:%lnpqrst:%zu:AE", NULL),
+    BUILTIN("read", 0, bin_read, 0, -1, 0, "bcd:ek:%lnpqrst:%zu:AE", NULL),
     BUILTIN("readonly", BINF_PLUSOPTS | BINF_MAGICEQUALS | BINF_PSPECIAL | BINF_ASSIGN, (HandlerFunc)bin_typeset, 0, -1, BIN_READONLY, "AE:%F:%HL:%R:%TUZ:%afghi:%lptux", "r"),
     BUILTIN("rehash", 0, bin_hash, 0, 0, 0, "df", "r"),
     BUILTIN("return", BINF_PSPECIAL, bin_break, 0, 1, BIN_RETURN, NULL, NULL),
@@ -674,6 +674,8 @@ bin_set(char *nam, char **args, UNUSED(Options ops), UNUSED(int func))
     queue_signals();
     if (!arrayname)
     {
+	if ((!hadopt && !*args) || array)
+	    importallenv();
 	if (!hadopt && !*args)
 	    scanhashtable(paramtab, 1, 0, 0, paramtab->printnode,
 			  hadplus ? PRINT_NAMEONLY : 0);
@@ -2668,6 +2670,7 @@ bin_typeset(char *name, char **argv, LinkList assigns, Options ops, int func)
 	    if (roff || OPT_ISSET(ops,'+'))
 		printflags |= PRINT_NAMEONLY;
 	}
+	importallenv();
 	scanhashtable(paramtab, 1, on|roff, 0, paramtab->printnode, printflags);
 	unqueue_signals();
 	return 0;
@@ -2877,6 +2880,7 @@ bin_typeset(char *name, char **argv, LinkList assigns, Options ops, int func)
 	    if (!on)
 		printflags |= PRINT_NAMEONLY;
 	}
+	importallenv();
 
 	while ((asg = getasg(&argv, assigns))) {
 	    LinkList pmlist = newlinklist();
@@ -3569,6 +3573,7 @@ bin_unset(char *name, char **argv, Options ops, int func)
 
     /* with -m option, treat arguments as glob patterns */
     if (OPT_ISSET(ops,'m')) {
+	importallenv();
 	while ((s = *argv++)) {
 	    queue_signals();
 	    /* expand */
@@ -4294,6 +4299,49 @@ mod_export LinkList bufstack;
 
 /* echo, print, printf, pushln */
 
+/* Add a character to a metafied string, returning the new end. */
+
+/**/
+static char *
+addmetachar(char *ptr, int c)
+{
+    if (imeta(c)) {
+	*ptr++ = Meta;
+	*ptr++ = c ^ 32;
+    } else
+	*ptr++ = c;
+    return ptr;
+}
+
+/*
+ * Join the arguments of print -v into a new value for the parameter.
+ * The arguments are metafied, so only the separator sep between them
+ * and the terminator term after them (if it isn't -1) need metafying.
+ */
+
+/**/
+static char *
+printvjoin(char **args, int sep, int term)
+{
+    char **ap, *ret, *ptr;
+    size_t len, total = 2;
+
+    for (ap = args; *ap; ap++)
+	total += strlen(*ap) + 2;
+    ptr = ret = (char *) zalloc(total + 1);
+    for (ap = args; *ap; ap++) {
+	len = strlen(*ap);
+	memcpy(ptr, *ap, len);
+	ptr += len;
+	if (ap[1])
+	    ptr = addmetachar(ptr, sep);
+    }
+    if (term >= 0)
+	ptr = addmetachar(ptr, term);
+    *ptr = '\0';
+    return ret;
+}
+
 #define print_val(VAL) \
     if (prec >= 0) \
 	count += fprintf(fout, spec, width, prec, VAL); \
@@ -4576,7 +4624,14 @@ bin_print(char *name, char **args, Options ops, int func)
 	}
     }
 
-    if (OPT_ISSET(ops, 'v') ||
+    /*
+     * print -v without a format, columns or tab expansion joins its
+     * arguments straight into the parameter below; anything else
+     * written to a parameter or the buffer stack goes via a stream.
+     */
+    if ((OPT_ISSET(ops, 'v') &&
+	 (fmt || OPT_ISSET(ops,'c') || OPT_ISSET(ops,'C') ||
+	  OPT_HASARG(ops,'x') || OPT_HASARG(ops,'X'))) ||
 	(fmt && (OPT_ISSET(ops,'z') || OPT_ISSET(ops,'s'))))
 	ASSIGN_MSTREAM(buf,fout);
 
@@ -4761,6 +4816,18 @@ bin_print(char *name, char **args, Options ops, int func)
 		metafy(args[n], len[n], META_NOALLOC);
 	}
 
+	/* -v option -- assign the arguments to a parameter */
+	if (OPT_ISSET(ops,'v') && !IS_MSTREAM(fout)) {
+	    int sep = OPT_ISSET(ops,'l') ? '\n' : OPT_ISSET(ops,'N') ? '\0' : ' ';
+	    int term = (OPT_ISSET(ops,'l') && !(OPT_ISSET(ops,'n') || nnl)) ?
+		(OPT_ISSET(ops,'N') ? '\0' : '\n') : -1;
+
+	    queue_signals();
+	    setsparam(OPT_ARG(ops, 'v'), printvjoin(args, sep, term));
+	    unqueue_signals();
+	    return 0;
+	}
+
 	/* -z option -- push the arguments onto the editing buffer stack */
 	if (OPT_ISSET(ops,'z')) {
 	    queue_signals();
@@ -5071,13 +5138,16 @@ bin_print(char *name, char **args, Options ops, int func)
 		     * widths are for characters, so we need to count
 		     * (in lchars).  However, if we need to truncate
 		     * the string we need the width in bytes (in lbytes).
+		     * Without a width or precision neither is needed, so
+		     * we don't count at all.
 		     */
 		    ptr = b;
 #ifdef MULTIBYTE_SUPPORT
 		    memset(&mbs, 0, sizeof(mbs));
 #endif
 
-		    for (lchars = 0, lleft = lbytes; lleft > 0; lchars++) {
+		    for (lchars = 0, lleft = (width || prec >= 0) ? lbytes : 0;
+			 lleft > 0; lchars++) {
 			int chars;
 
 			if (lchars == prec) {
@@ -5782,6 +5852,75 @@ bin_dot(char *name, char **argv, UNUSED(Options ops), UNUSED(int func))
     return ret == SOURCE_OK ? lastval : 128 - ret;
 }
 
+/*
+ * Cache of recently parsed eval strings, so that the same code
+ * evaluated repeatedly, for example in a loop, is only parsed once.
+ * The result depends on the options, aliases and reserved words in
+ * effect as well as the text, so these are checked too.  Each use
+ * gets its own copy of the program on the heap, just as if it had
+ * been parsed afresh.
+ */
+
+#define EVALCACHE_SIZE	32	/* number of strings remembered */
+#define EVALCACHE_MAX	4096	/* length of longest string remembered */
+
+struct evalcache {
+    char *text;
+    unsigned hashval;
+    zlong lexgen;
+    int noaliases;
+    char opts[OPT_SIZE];
+    Eprog prog;
+};
+
+static struct evalcache evalcache[EVALCACHE_SIZE];
+static int evalcachenext;
+
+/* Uses of the eval cache that found, or did not find, the code */
+
+/**/
+zlong evalcachehits, evalcachemisses;
+
+/**/
+static Eprog
+evalparse(char *s)
+{
+    struct evalcache *ec;
+    unsigned hashval;
+    Eprog prog;
+    int i;
+
+    if (strlen(s) > EVALCACHE_MAX)
+	return parse_string(s, 1);
+    hashval = hasher(s);
+    for (i = 0, ec = evalcache; i < EVALCACHE_SIZE; i++, ec++) {
+	if (ec->prog && ec->hashval == hashval &&
+	    ec->lexgen == lexgen && ec->noaliases == noaliases &&
+	    !strcmp(ec->text, s) && !memcmp(ec->opts, opts, OPT_SIZE)) {
+	    evalcachehits++;
+	    return dupeprog(ec->prog, 1);
+	}
+    }
+    evalcachemisses++;
+    if (!(prog = parse_string(s, 1)) || errflag)
+	return prog;
+
+    ec = evalcache + evalcachenext;
+    evalcachenext = (evalcachenext + 1) % EVALCACHE_SIZE;
+    if (ec->prog) {
+	freeeprog(ec->prog);
+	zsfree(ec->text);
+    }
+    ec->text = ztrdup(s);
+    ec->hashval = hashval;
+    ec->lexgen = lexgen;
+    ec->noaliases = noaliases;
+    memcpy(ec->opts, opts, OPT_SIZE);
+    ec->prog = dupeprog(prog, 0);
+
+    return prog;
+}
+
 /*
  * common for bin_emulate and bin_eval
  */
@@ -5839,7 +5978,7 @@ eval(char **argv)
     } else
 	fpushed = 0;
 
-    prog = parse_string(zjoin(argv, ' ', 1), 1);
+    prog = evalparse(zjoin(argv, ' ', 1));
     if (prog) {
 	if (wc_code(*prog->prog) != WC_LIST) {
 	    /* No code to execute */
@@ -6037,6 +6176,108 @@ bin_eval(UNUSED(char *nam), char **argv, UNUSED(Options ops), UNUSED(int func))
 static char *zbuf;
 static int readfd;
 
+/*
+ * Input read ahead by the read builtin.  From a regular file, read
+ * takes what it likes and seeks back over anything it didn't use
+ * before it returns, so it leaves the file where reading a byte at a
+ * time would have.  Other input can't be given back, so is only read
+ * ahead with read -b; what's left over is kept for the next read from
+ * the same file descriptor, as long as that still refers to the same
+ * file, but is lost to anything else reading from it.
+ */
+
+#define READBUFSIZ 8192
+
+struct readbuf {
+    dev_t dev;			/* device and inode of the file */
+    ino_t ino;
+    int seekable;		/* a regular file: put back what's unused */
+    int ahead;			/* read ahead when the buffer runs out */
+    int chunk;			/* how much to read next time */
+    int pos, len;		/* unread input is buf[pos] to buf[len-1] */
+    char buf[READBUFSIZ];
+};
+
+/* Buffers indexed by file descriptor, and the one in use by zread() */
+
+static struct readbuf **readbufs;
+static int readbufs_size;
+static struct readbuf *curreadbuf;
+
+/*
+ * Find the buffer for fd, creating one if the file is seekable or
+ * ahead is set.  Return NULL if input from fd is to be read a byte at
+ * a time.
+ */
+
+/**/
+static struct readbuf *
+readbuf_get(int fd, int ahead)
+{
+    struct readbuf *rb;
+    struct stat st;
+    int seekable;
+
+    if (fd < 0 || fstat(fd, &st))
+	return NULL;
+    if ((rb = fd < readbufs_size ? readbufs[fd] : NULL)) {
+	if (rb == curreadbuf)
+	    /* in use by a read we interrupted */
+	    return NULL;
+	if (rb->dev == st.st_dev && rb->ino == st.st_ino) {
+	    rb->ahead = ahead || rb->seekable;
+	    return rb;
+	}
+	/* fd now refers to something else, so what's left isn't ours */
+	zfree(rb, sizeof(struct readbuf));
+	readbufs[fd] = NULL;
+    }
+    seekable = S_ISREG(st.st_mode) && lseek(fd, 0, SEEK_CUR) != (off_t)-1;
+    if (!seekable && !ahead)
+	return NULL;
+
+    if (fd >= readbufs_size) {
+	int newsize = readbufs_size ? readbufs_size : 16;
+
+	while (newsize <= fd)
+	    newsize *= 2;
+	readbufs = (struct readbuf **)
+	    zrealloc(readbufs, newsize * sizeof(struct readbuf *));
+	memset(readbufs + readbufs_size, 0,
+	       (newsize - readbufs_size) * sizeof(struct readbuf *));
+	readbufs_size = newsize;
+    }
+    rb = readbufs[fd] = (struct readbuf *) zalloc(sizeof(struct readbuf));
+    rb->dev = st.st_dev;
+    rb->ino = st.st_ino;
+    rb->seekable = seekable;
+    rb->ahead = 1;
+    /* Lines are usually short; start small and grow if they aren't. */
+    rb->chunk = seekable ? 128 : READBUFSIZ;
+    rb->pos = rb->len = 0;
+    return rb;
+}
+
+/*
+ * Finished reading a line through curreadbuf: give back any input
+ * read from a seekable file but not used, and go back to the buffer
+ * of any read we interrupted.
+ */
+
+/**/
+static void
+readbuf_done(struct readbuf *oldrb)
+{
+    struct readbuf *rb = curreadbuf;
+
+    if (rb && rb->seekable) {
+	if (rb->pos < rb->len)
+	    lseek(readfd, (off_t)(rb->pos - rb->len), SEEK_CUR);
+	rb->pos = rb->len = 0;
+    }
+    curreadbuf = oldrb;
+}
+
 /* Read a character from readfd, or from the buffer zbuf.  Return EOF on end of
 file/buffer. */
 
@@ -6061,6 +6302,7 @@ bin_read(char *name, char **args, Options ops, UNUSED(int func))
     struct ttyinfo saveti;
     char d;
     long izle_timeout = 0;
+    struct readbuf *rb, *oldrb = curreadbuf;
 #ifdef MULTIBYTE_SUPPORT
     wchar_t delim = L'\n', wc;
     mbstate_t mbs;
@@ -6216,6 +6458,8 @@ bin_read(char *name, char **args, Options ops, UNUSED(int func))
 	    settyinfo(&ti);
 	}
     }
+    rb = (izle || OPT_ISSET(ops,'z')) ? NULL :
+	readbuf_get(readfd, OPT_ISSET(ops,'b'));
     if (OPT_ISSET(ops,'t')) {
 	zlong timeout = 0;
 	if (OPT_HASARG(ops,'t')) {
@@ -6242,7 +6486,7 @@ bin_read(char *name, char **args, Options ops, UNUSED(int func))
 	    if ((zlong)izle_timeout != timeout)
 		izle_timeout = LONG_MAX;
 #endif
-	} else {
+	} else if (!rb || rb->pos == rb->len) {
 	    if (readfd == -1 ||
 		!read_poll(readfd, &readchar, keys && !zleactive,
 			   timeout)) {
@@ -6308,6 +6552,13 @@ bin_read(char *name, char **args, Options ops, UNUSED(int func))
 		    *bptr = readchar;
 		    val = 1;
 		    readchar = -1;
+		} else if (rb && rb->pos < rb->len) {
+		    /* left over from an earlier read -b */
+		    val = rb->len - rb->pos;
+		    if (val > nchars)
+			val = nchars;
+		    memcpy(bptr, rb->buf + rb->pos, val);
+		    rb->pos += val;
 		} else {
 		    while ((val = read(readfd, bptr, nchars)) < 0) {
 			if (errno != EINTR ||
@@ -6403,6 +6654,7 @@ bin_read(char *name, char **args, Options ops, UNUSED(int func))
 	(nonempty(bufstack)) ? (char *) getlinknode(bufstack) : ztrdup("");
     first = 1;
     bslash = 0;
+    curreadbuf = rb;
     while (*args || (OPT_ISSET(ops,'A') && !gotnl)) {
 	sigset_t s = child_unblock();
 	buf = bptr = (char *)zalloc(bsiz = 64);
@@ -6583,6 +6835,8 @@ bin_read(char *name, char **args, Options ops, UNUSED(int func))
 	char **pp, **p = NULL;
 	LinkNode n;
 
+	readbuf_done(oldrb);
+
 	p = (OPT_ISSET(ops,'e') ? (char **)NULL
 	     : (char **)zalloc((al + 1) * sizeof(char *)));
 
@@ -6710,6 +6964,7 @@ bin_read(char *name, char **args, Options ops, UNUSED(int func))
 	}
 	signal_setmask(s);
     }
+    readbuf_done(oldrb);
 #ifdef MULTIBYTE_SUPPORT
     if (ret != MB_INCOMPLETE)
 	bptr = laststart;
@@ -6766,6 +7021,7 @@ bin_read(char *name, char **args, Options ops, UNUSED(int func))
 static int
 zread(int izle, int *readchar, long izle_timeout)
 {
+    struct readbuf *rb;
     char cc, retry = 0;
     int ret;
 
@@ -6790,9 +7046,28 @@ zread(int izle, int *readchar, long izle_timeout)
 	*readchar = -1;
 	return STOUC(cc);
     }
+    if ((rb = curreadbuf)) {
+	if (rb->pos < rb->len)
+	    return STOUC(rb->buf[rb->pos++]);
+	if (!rb->ahead)
+	    rb = NULL;
+	else if (rb->seekable && rb->len && rb->chunk < READBUFSIZ)
+	    /* the line didn't fit, so read more next time */
+	    rb->chunk *= 2;
+    }
     for (;;) {
-	/* read a character from readfd */
-	ret = read(readfd, &cc, 1);
+	if (rb) {
+	    /* fill the buffer from readfd */
+	    if ((ret = read(readfd, rb->buf, rb->chunk)) > 0) {
+		rb->pos = 1;
+		rb->len = ret;
+		return STOUC(*rb->buf);
+	    }
+	    rb->pos = rb->len = 0;
+	} else {
+	    /* read a character from readfd */
+	    ret = read(readfd, &cc, 1);
+	}
 	switch (ret) {
 	case 1:
 	    /* return the character read */
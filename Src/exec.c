@@ -204,6 +204,24 @@ struct execstack *exstack;
 /**/
 mod_export Funcstack funcstack;
 
+/*
+ * Set while the zsh/zsample module has the profiling timer running.
+ * A program we exec would inherit the timer but not the handler, so
+ * the timer is stopped first.
+ */
+
+/**/
+mod_export int sampletimer;
+
+/*
+ * If set, called as each simple command or pipeline starts, once
+ * lineno is up to date, with the state of the program being run.
+ * This is used by the zsh/zcover module.
+ */
+
+/**/
+mod_export void (*execlinehook) _((Estate));
+
 #define execerr()				\
     do {					\
 	if (!forked) {				\
@@ -480,6 +498,14 @@ zexecve(char *pth, char **argv, char **newenvp)
 
     if (newenvp == NULL)
 	    newenvp = environ;
+#ifdef HAVE_SETITIMER
+    if (sampletimer) {
+	struct itimerval it;
+
+	memset(&it, 0, sizeof(it));
+	setitimer(ITIMER_PROF, &it, NULL);
+    }
+#endif
     winch_unblock();
     execve(pth, argv, newenvp);
 
@@ -1100,6 +1126,8 @@ entersubsh(int flags)
 	opts[MONITOR] = 0;
     opts[USEZLE] = 0;
     zleactive = 0;
+    /* Nor zle's pipe for noticing children, which isn't ours */
+    chldwakefd = -1;
     /*
      * If we've saved fd's for later restoring, we're never going
      * to restore them now, so just close them.
@@ -1174,6 +1202,31 @@ execode(Eprog p, int dont_change_job, int exiting, char *context)
     zsh_eval_context[alen] = NULL;
 }
 
+/*
+ * Return the name of the file being executed and set *linep to the
+ * line in it, as for the prompt escapes %x and %I.  This only looks
+ * at the function stack, so is safe in a signal handler.
+ */
+
+/**/
+mod_export char *
+execfileline(zlong *linep)
+{
+    zlong line = lineno;
+    char *file;
+
+    if (funcstack && funcstack->tp != FS_SOURCE && !IN_EVAL_TRAP()) {
+	file = funcstack->filename;
+	line += funcstack->flineno;
+	/* take account of eval line nos. starting at 1 */
+	if (funcstack->tp == FS_EVAL)
+	    line--;
+    } else
+	file = scriptfilename ? scriptfilename : argzero;
+    *linep = line;
+    return file ? file : "";
+}
+
 /* Execute a simplified command. This is used to execute things that
  * will run completely in the shell, so that we can by-pass all that
  * nasty job-handling and redirection stuff in execpline and execcmd. */
@@ -1192,8 +1245,11 @@ execsimple(Estate state)
 	return lastval = 0;
 
     /* In evaluated traps, don't modify the line number. */
-    if (!IN_EVAL_TRAP() && !ineval && code)
+    if (!IN_EVAL_TRAP() && !ineval && code) {
 	lineno = code - 1;
+	if (execlinehook)
+	    execlinehook(state);
+    }
 
     code = wc_code(*state->pc++);
 
@@ -1884,8 +1940,11 @@ execpline2(Estate state, wordcode pcode,
 	return;
 
     /* In evaluated traps, don't modify the line number. */
-    if (!IN_EVAL_TRAP() && !ineval && WC_PIPE_LINENO(pcode))
+    if (!IN_EVAL_TRAP() && !ineval && WC_PIPE_LINENO(pcode)) {
 	lineno = WC_PIPE_LINENO(pcode) - 1;
+	if (execlinehook)
+	    execlinehook(state);
+    }
 
     if (pline_level == 1) {
 	if ((how & Z_ASYNC) || !sfcontext)
@@ -5368,12 +5427,13 @@ loadautofnsetfile(Shfunc shf, char *fdir)
 Shfunc
 loadautofn(Shfunc shf, int fksh, int autol, int current_fpath)
 {
-    int noalias = noaliases, ksh = 1;
+    int noalias = noaliases, ksh = 1, ev;
     Eprog prog;
     char *fdir;			/* Directory path where func found */
 
     pushheap();
 
+    ev = startup_enter("autoload", shf->node.nam);
     noaliases = (shf->node.flags & PM_UNALIASED);
     if (shf->filename && shf->filename[0] == '/' &&
 	(shf->node.flags & PM_LOADDIR))
@@ -5389,6 +5449,7 @@ loadautofn(Shfunc shf, int fksh, int autol, int current_fpath)
     else
 	prog = getfpfunc(shf->node.nam, &ksh, &fdir, NULL, 0);
     noaliases = noalias;
+    startup_leave(ev);
 
     if (ksh == 1) {
 	ksh = fksh;
@@ -5864,7 +5925,7 @@ getfpfunc(char *s, int *ksh, char **fdir, char **alt_path, int test_only)
     off_t rlen;
     char *d;
     Eprog r;
-    int fd;
+    int fd, present;
 
     pp = alt_path ? alt_path : fpath;
     for (; *pp; pp++) {
@@ -5874,12 +5935,21 @@ getfpfunc(char *s, int *ksh, char **fdir, char **alt_path, int test_only)
 	    sprintf(buf, "%s/%s", *pp, s);
 	else
 	    strcpy(buf, s);
-	if ((r = try_dump_file(*pp, s, buf, ksh, test_only))) {
+	present = fpdirhas(*pp, s);
+	if ((r = try_dump_file(*pp, s, present ? buf : NULL,
+			       ksh, test_only))) {
 	    if (fdir)
 		*fdir = *pp;
 	    return r;
 	}
+	if (!present)
+	    continue;
 	unmetafy(buf, NULL);
+	if (!test_only && (r = try_cache_file(buf, s, ksh))) {
+	    if (fdir)
+		*fdir = *pp;
+	    return r;
+	}
 	if (!access(buf, R_OK) && (fd = open(buf, O_RDONLY | O_NOCTTY)) != -1) {
 	    struct stat st;
 	    if (!fstat(fd, &st) && S_ISREG(st.st_mode) &&
@@ -2221,6 +2221,286 @@ bracechardots(char *str, convchar_t *c1p, convchar_t *c2p)
     return 1;
 }
 
+/*
+ * Parse a range in braces, {n1..n2[..incr]} or {c1..c2}, from str at
+ * the opening brace to str2 at the closing one; dotdot is the number of
+ * `..' in between.  Returns 1 and fills in br if it is a valid range.
+ */
+
+/**/
+static int
+getbracerange(char *str, char *str2, int dotdot, Bracerange br)
+{
+    char *dots, *p, *dots2 = NULL;
+    zlong rstart, rend;
+    int err = 0, rev = 0, rincr = 1;
+    int wid1, wid2, wid3;
+    convchar_t cstart, cend;
+
+    if (bracechardots(str, &cstart, &cend)) {
+	/*
+	 * This is a character range.
+	 */
+	br->chars = 1;
+	br->minw = 0;
+	br->first = cstart;
+	if (cend < cstart) {
+	    br->incr = -1;
+	    br->count = cstart - cend + 1;
+	} else {
+	    br->incr = 1;
+	    br->count = cend - cstart + 1;
+	}
+	return 1;
+    }
+
+    /* Get the first number of the range */
+    rstart = zstrtol(str+1,&dots,10);
+    rend = 0;
+    wid1 = (dots - str) - 1;
+    wid2 = (str2 - dots) - 2;
+    wid3 = 0;
+
+    if (dots == str + 1 || *dots != '.' || dots[1] != '.')
+	err++;
+    else {
+	/* Get the last number of the range */
+	rend = zstrtol(dots+2,&p,10);
+	if (p == dots+2)
+	    err++;
+	/* check for {num1..num2..incr} */
+	if (p != str2) {
+	    wid2 = (p - dots) - 2;
+	    dots2 = p;
+	    if (dotdot == 2 && *p == '.' && p[1] == '.') {
+		rincr = zstrtol(p+2, &p, 10);
+		wid3 = p - dots2 - 2;
+		if (p != str2 || !rincr)
+		    err++;
+	    } else
+		err++;
+	}
+    }
+    if (err)
+	return 0;
+
+    /* If either no. begins with a zero, pad the output with   *
+     * zeroes. Otherwise, set min width to 0 to suppress them.
+     * str+1 is the first number in the range, dots+2 the last,
+     * and dots2+2 is the increment if that's given. */
+    /* TODO: sorry about this */
+    br->minw = (str[1] == '0' ||
+		(IS_DASH(str[1]) && str[2] == '0'))
+	       ? wid1
+	       : (dots[2] == '0' ||
+		  (IS_DASH(dots[2]) && dots[3] == '0'))
+	       ? wid2
+	       : (dots2 && (dots2[2] == '0' ||
+			    (IS_DASH(dots2[2]) && dots2[3] == '0')))
+	       ? wid3
+	       : 0;
+    if (rincr < 0) {
+	/* Handle negative increment */
+	rincr = -rincr;
+	rev = !rev;
+    }
+    if (rstart > rend) {
+	/* Handle decreasing ranges correctly. */
+	zlong rt = rend;
+	rend = rstart;
+	rstart = rt;
+	rev = !rev;
+    } else if (rincr > 1) {
+	/* when incr > 1, range is aligned to the highest number of str1,
+	 * compensate for this so that it is aligned to the first number */
+	rend -= (rend - rstart) % rincr;
+    }
+    /* The values run down from rend while at least rstart */
+    br->chars = 0;
+    br->count = (rend - rstart) / rincr + 1;
+    if (rev) {
+	br->first = rend;
+	br->incr = -rincr;
+    } else {
+	br->first = rend - (br->count - 1) * rincr;
+	br->incr = rincr;
+    }
+    return 1;
+}
+
+/* Return the text of the i'th value of a brace range, on the heap. */
+
+/**/
+static char *
+bracerangeval(Bracerange br, zlong i)
+{
+    zlong val = br->first + i * br->incr;
+
+    if (br->chars) {
+#ifdef MULTIBYTE_SUPPORT
+	mb_charinit();
+	return dupstring(wcs_nicechar((convchar_t)val, NULL, NULL));
+#else
+	char buf[2];
+
+	buf[0] = (char)val;
+	buf[1] = '\0';
+	return dupstring(buf);
+#endif
+    } else {
+	char buf[DIGBUFSIZE + 1];
+
+#if defined(ZLONG_IS_LONG_LONG) && defined(PRINTF_HAS_LLD)
+	sprintf(buf, "%0*lld", br->minw, val);
+#else
+	sprintf(buf, "%0*ld", br->minw, (long)val);
+#endif
+	return dupstring(buf);
+    }
+}
+
+/*
+ * Check that a brace group from str to str2 is a range that
+ * hasbraces() and xpandbraces() would expand as such, and parse it.
+ */
+
+/**/
+static int
+isbracerange(char *str, char *str2, Bracerange br)
+{
+    char *p = str + 1;
+    int dotdot = 0, n;
+
+    if (!bracechardots(str, NULL, NULL)) {
+	/* Insist on digits in each number, as hasbraces() does */
+	for (n = 0; n < 3; n++) {
+	    if (IS_DASH(*p))
+		p++;
+	    if (!idigit(*p))
+		return 0;
+	    while (idigit(*p))
+		p++;
+	    if (p == str2)
+		break;
+	    if (n == 2 || p[0] != '.' || p[1] != '.')
+		return 0;
+	    p += 2;
+	}
+    }
+    for (p = str + 1; p < str2; p++)
+	if (*p == Comma || *p == Inbrace)
+	    return 0;
+	else if (*p == '.' && p[1] == '.') {
+	    dotdot++;
+	    p++;
+	}
+    return dotdot && getbracerange(str, str2, dotdot, br);
+}
+
+/*
+ * Prepare to produce the words of a for loop's list one at a time,
+ * if that's equivalent to expanding the list first.  That's the case
+ * if each word is plain text except for brace ranges, such as
+ * {1..10000000} or {a..z}{1..9}, so there's nothing else to expand
+ * and no side effects; then we don't need memory for all the words
+ * at once.  Returns NULL if the list must be expanded as usual.
+ */
+
+/**/
+Rangeiter
+newrangeiter(LinkList args)
+{
+    Rangeiter it = (Rangeiter) hcalloc(sizeof(struct rangeiter));
+    LinkNode node;
+    int maxr = 0;
+
+    if (isset(IGNOREBRACES))
+	return NULL;
+    it->nwords = countlinknodes(args);
+    it->words = (struct rangeword *)
+	hcalloc(it->nwords * sizeof(struct rangeword));
+    it->nwords = 0;
+    for (node = firstnode(args); node; incnode(node), it->nwords++) {
+	struct rangeword *rw = it->words + it->nwords;
+	char *str = (char *) getdata(node), *p, *lit, *end;
+	int n = 0;
+
+	for (p = str; *p; p++)
+	    if (*p == Inbrace)
+		n++;
+	rw->lits = (char **) hcalloc((n + 1) * sizeof(char *));
+	rw->ranges = (Bracerange) hcalloc((n + 1) * sizeof(struct bracerange));
+	for (p = lit = str; *p; ) {
+	    if (*p == Inbrace) {
+		for (end = p + 1; *end && *end != Outbrace; end++)
+		    ;
+		if (!*end || !isbracerange(p, end, rw->ranges + rw->nranges))
+		    return NULL;
+		rw->lits[rw->nranges++] = dupstrpfx(lit, p - lit);
+		p = lit = end + 1;
+	    } else if (itok(*p))
+		return NULL;
+	    else
+		p++;
+	}
+	rw->lits[rw->nranges] = lit;
+	if (rw->nranges > maxr)
+	    maxr = rw->nranges;
+    }
+    if (!maxr)
+	return NULL;
+    it->nwords = countlinknodes(args);
+    it->word = 0;
+    it->idx = (zlong *) hcalloc(maxr * sizeof(zlong));
+    return it;
+}
+
+/* Return the next word from a range iterator, or NULL at the end. */
+
+/**/
+char *
+rangeiternext(Rangeiter it)
+{
+    struct rangeword *rw;
+    char **vals, *ret, *p;
+    int i, len;
+
+    if (it->word >= it->nwords)
+	return NULL;
+    rw = it->words + it->word;
+    vals = (char **) zhalloc((rw->nranges + 1) * sizeof(char *));
+    len = strlen(rw->lits[rw->nranges]);
+    for (i = 0; i < rw->nranges; i++) {
+	vals[i] = bracerangeval(rw->ranges + i, it->idx[i]);
+	len += strlen(rw->lits[i]) + strlen(vals[i]);
+    }
+    ret = p = (char *) zhalloc(len + 1);
+    for (i = 0; i < rw->nranges; i++) {
+	p = strcpy(p, rw->lits[i]) + strlen(rw->lits[i]);
+	p = strcpy(p, vals[i]) + strlen(vals[i]);
+    }
+    strcpy(p, rw->lits[rw->nranges]);
+
+    /* The last range varies fastest, as when braces are expanded. */
+    for (i = rw->nranges; i--; ) {
+	if (++it->idx[i] < rw->ranges[i].count)
+	    break;
+	it->idx[i] = 0;
+    }
+    if (i < 0)
+	it->word++;
+    return ret;
+}
+
+/* Check if a range iterator has no more words. */
+
+/**/
+int
+rangeiterdone(Rangeiter it)
+{
+    return it->word >= it->nwords;
+}
+
 /* brace expansion */
 
 /**/
@@ -2251,126 +2531,23 @@ xpandbraces(LinkList list, LinkNode *np)
     if (!comma && dotdot) {
 	/* Expand range like 0..10 numerically: comma or recursive
 	   brace expansion take precedence. */
-	char *dots, *p, *dots2 = NULL;
-	LinkNode olast = last;
-	/* Get the first number of the range */
-	zlong rstart, rend;
-	int err = 0, rev = 0, rincr = 1;
-	int wid1, wid2, wid3, strp;
-	convchar_t cstart, cend;
-
-	if (bracechardots(str, &cstart, &cend)) {
-	    int lenalloc;
-	    /*
-	     * This is a character range.
-	     */
-	    if (cend < cstart) {
-		convchar_t ctmp = cend;
-		cend = cstart;
-		cstart = ctmp;
-		rev = 1;
-	    }
-	    uremnode(list, node);
-	    strp = str - str3;
-	    lenalloc = strp + strlen(str2+1) + 1;
-	    do {
-#ifdef MULTIBYTE_SUPPORT
-		char *ncptr;
-		int nclen;
-		mb_charinit();
-		ncptr = wcs_nicechar(cend, NULL, NULL);
-		nclen = strlen(ncptr);
-		p = zhalloc(lenalloc + nclen);
-		memcpy(p, str3, strp);
-		memcpy(p + strp, ncptr, nclen);
-		strcpy(p + strp + nclen, str2 + 1);
-#else
-		p = zhalloc(lenalloc + 1);
-		memcpy(p, str3, strp);
-		sprintf(p + strp, "%c", cend);
-		strcat(p + strp, str2 + 1);
-#endif
-		insertlinknode(list, last, p);
-		if (rev)	/* decreasing:  add in reverse order. */
-		    last = nextnode(last);
-	    } while (cend-- > cstart);
-	    *np = nextnode(olast);
-	    return;
-	}
+	struct bracerange br;
 
-	/* Get the first number of the range */
-	rstart = zstrtol(str+1,&dots,10);
-	rend = 0;
-	wid1 = (dots - str) - 1;
-	wid2 = (str2 - dots) - 2;
-	wid3 = 0;
-	strp = str - str3;
+	if (getbracerange(str, str2, dotdot, &br)) {
+	    LinkNode olast = last;
+	    int strp = str - str3, slen = strlen(str2 + 1);
+	    zlong i;
 
-	if (dots == str + 1 || *dots != '.' || dots[1] != '.')
-	    err++;
-	else {
-	    /* Get the last number of the range */
-	    rend = zstrtol(dots+2,&p,10);
-	    if (p == dots+2)
-		err++;
-	    /* check for {num1..num2..incr} */
-	    if (p != str2) {
-		wid2 = (p - dots) - 2;
-		dots2 = p;
-		if (dotdot == 2 && *p == '.' && p[1] == '.') {
-		    rincr = zstrtol(p+2, &p, 10);
-		    wid3 = p - dots2 - 2;
-		    if (p != str2 || !rincr)
-			err++;
-		} else
-		    err++;
-	    }
-	}
-	if (!err) {
-	    /* If either no. begins with a zero, pad the output with   *
-	     * zeroes. Otherwise, set min width to 0 to suppress them.
-	     * str+1 is the first number in the range, dots+2 the last,
-	     * and dots2+2 is the increment if that's given. */
-	    /* TODO: sorry about this */
-	    int minw = (str[1] == '0' ||
-			(IS_DASH(str[1]) && str[2] == '0'))
-		       ? wid1
-		       : (dots[2] == '0' ||
-			  (IS_DASH(dots[2]) && dots[3] == '0'))
-		       ? wid2
-		       : (dots2 && (dots2[2] == '0' ||
-				    (IS_DASH(dots2[2]) && dots2[3] == '0')))
-		       ? wid3
-		       : 0;
-	    if (rincr < 0) {
-		/* Handle negative increment */
-		rincr = -rincr;
-		rev = !rev;
-	    }
-	    if (rstart > rend) {
-		/* Handle decreasing ranges correctly. */
-		zlong rt = rend;
-		rend = rstart;
-		rstart = rt;
-		rev = !rev;
-	    } else if (rincr > 1) {
-		/* when incr > 1, range is aligned to the highest number of str1,
-		 * compensate for this so that it is aligned to the first number */
-		rend -= (rend - rstart) % rincr;
-	    }
 	    uremnode(list, node);
-	    for (; rend >= rstart; rend -= rincr) {
-		/* Node added in at end, so do highest first */
-		p = dupstring(str3);
-#if defined(ZLONG_IS_LONG_LONG) && defined(PRINTF_HAS_LLD)
-		sprintf(p + strp, "%0*lld", minw, rend);
-#else
-		sprintf(p + strp, "%0*ld", minw, (long)rend);
-#endif
-		strcat(p + strp, str2 + 1);
-		insertlinknode(list, last, p);
-		if (rev)	/* decreasing:  add in reverse order. */
-		    last = nextnode(last);
+	    for (i = 0; i < br.count; i++) {
+		char *val = bracerangeval(&br, i), *p;
+		int vlen = strlen(val);
+
+		p = zhalloc(strp + vlen + slen + 1);
+		memcpy(p, str3, strp);
+		memcpy(p + strp, val, vlen);
+		strcpy(p + strp + vlen, str2 + 1);
+		last = insertlinknode(list, last, p);
 	    }
 	    *np = nextnode(olast);
 	    return;
@@ -2759,6 +2936,72 @@ set_pat_end(Patprog p, char null_me)
 	p->flags &= ~PAT_NOTEND;
 }
 
+/*
+ * Return the byte any match of the pattern must start with, or -1 if
+ * we don't know one.  The byte is that of the unmetafied string, as
+ * passed to pattrylen() by igetmatch().  Positions in the string not
+ * starting with it can be skipped without running the matcher.
+ */
+
+/**/
+static int
+pat_first_byte(Patprog p)
+{
+    if (p->flags & PAT_PURES) {
+	char *str = (char *)p + p->startoff;
+
+	if (!p->patmlen)
+	    return -1;
+	return STOUC(*str == Meta ? str[1] ^ 32 : *str);
+    }
+    return p->patstartch ? STOUC(p->patstartch) : -1;
+}
+
+/* Test whether a match of a pattern can start at t, given pat_first_byte() */
+
+#define PAT_CAN_START(c, t, send) \
+    ((c) < 0 || ((t) < (send) && STOUC(*(t)) == (c)))
+
+/*
+ * Perform the must-match test for complex closures:  return 0 if the
+ * unmetafied string s of length len doesn't contain the longest literal
+ * in the pattern, so can't match.
+ */
+
+/**/
+static int
+pat_has_must(Patprog p, char *s, int len)
+{
+    char *muststr = (char *)p + p->mustoff, *t, *tend;
+
+    if (!p->patmlen)
+	return 1;
+    if (p->patmlen > len)
+	return 0;
+    for (t = s, tend = s + len - p->patmlen;
+	 t <= tend && (t = memchr(t, *muststr, tend - t + 1)); t++)
+	if (!memcmp(muststr, t, p->patmlen))
+	    return 1;
+    return 0;
+}
+
+/*
+ * Test whether get_match_ret() would return the whole of the trial
+ * string unchanged, either because everything matched and that's what
+ * was asked for or because nothing did and we want the rest.  Then
+ * the caller can keep the string it passed rather than copying it.
+ */
+
+/**/
+static int
+match_ret_whole(Imatchdata imd, int matched)
+{
+    if (imd->replstr || (imd->flags & SUB_LIST))
+	return 0;
+    return (imd->flags & (SUB_MATCH|SUB_REST|SUB_BIND|SUB_EIND|SUB_LEN)) ==
+	(matched ? SUB_MATCH : SUB_REST);
+}
+
 /**/
 #ifdef MULTIBYTE_SUPPORT
 
@@ -2797,7 +3040,7 @@ igetmatch(char **sp, Patprog p, int fl, int n, char *replstr,
      * the string (typically t).
      */
     int ioff, l = strlen(*sp), matched = 1, umltot = ztrlen(*sp);
-    int umlen, nmatches;
+    int umlen, nmatches, c = pat_first_byte(p);
     struct patstralloc patstralloc;
     struct imatchdata imd;
 
@@ -2816,32 +3059,21 @@ igetmatch(char **sp, Patprog p, int fl, int n, char *replstr,
 
     /* perform must-match test for complex closures */
     if (p->mustoff)
-    {
-	char *muststr = (char *)p + p->mustoff;
-
-	matched = 0;
-	if (p->patmlen <= umltot)
-	{
-	    for (t = s; t <= send - p->patmlen; t++)
-	    {
-		if (!memcmp(muststr, t, p->patmlen)) {
-		    matched = 1;
-		    break;
-		}
-	    }
-	}
-    }
+	matched = pat_has_must(p, s, umltot);
 
     /* in case we used the prog before... */
     p->flags &= ~(PAT_NOTSTART|PAT_NOTEND);
 
     if (fl & SUB_ALL) {
-	int i = matched && pattrylen(p, s, umltot, 0, &patstralloc, 0);
+	int i = matched && PAT_CAN_START(c, s, send) &&
+	    pattrylen(p, s, umltot, 0, &patstralloc, 0);
 	if (!i) {
 	    /* Perform under no-match conditions */
 	    umltot = 0;
 	    imd.replstr = NULL;
 	}
+	if (match_ret_whole(&imd, i))
+	    return 1;
 	*sp = get_match_ret(&imd, 0, umltot);
 	if (! **sp && (((fl & SUB_MATCH) && !i) || ((fl & SUB_REST) && i)))
 	    return 0;
@@ -2909,7 +3141,8 @@ igetmatch(char **sp, Patprog p, int fl, int n, char *replstr,
 	    tmatch = NULL;
 	    for (ioff = 0, t = s, umlen = umltot; t < send; ioff++) {
 		set_pat_start(p, t-s);
-		if (pattrylen(p, t, umlen, 0, &patstralloc, ioff))
+		if (PAT_CAN_START(c, t, send) &&
+		    pattrylen(p, t, umlen, 0, &patstralloc, ioff))
 		    tmatch = t;
 		if (fl & SUB_START)
 		    break;
@@ -2933,7 +3166,8 @@ igetmatch(char **sp, Patprog p, int fl, int n, char *replstr,
 	    mb_charinit();
 	    for (ioff = 0, t = s, umlen = umltot; t <= send ; ioff++) {
 		set_pat_start(p, t-s);
-		if (pattrylen(p, t, umlen, 0, &patstralloc, ioff)) {
+		if (PAT_CAN_START(c, t, send) &&
+		    pattrylen(p, t, umlen, 0, &patstralloc, ioff)) {
 		    *sp = get_match_ret(&imd, t-s, umltot);
 		    return 1;
 		}
@@ -2976,7 +3210,8 @@ igetmatch(char **sp, Patprog p, int fl, int n, char *replstr,
 		for (; t <= send; ioff++) {
 		    /* Find the longest match from this position. */
 		    set_pat_start(p, t-s);
-		    if (pattrylen(p, t, umlen, 0, &patstralloc, ioff)) {
+		    if (PAT_CAN_START(c, t, send) &&
+			pattrylen(p, t, umlen, 0, &patstralloc, ioff)) {
 			char *mpos = t + patmatchlen();
 			if (!(fl & SUB_LONG) && !(p->flags & PAT_PURES)) {
 			    char *ptr;
@@ -3074,7 +3309,8 @@ igetmatch(char **sp, Patprog p, int fl, int n, char *replstr,
 	    mb_charinit();
 	    for (ioff = 0, t = s, umlen = umltot; t < send; ioff++) {
 		set_pat_start(p, t-s);
-		if (pattrylen(p, t, umlen, 0, &patstralloc, ioff)) {
+		if (PAT_CAN_START(c, t, send) &&
+		    pattrylen(p, t, umlen, 0, &patstralloc, ioff)) {
 		    nmatches++;
 		    tmatch = t;
 		}
@@ -3090,7 +3326,8 @@ igetmatch(char **sp, Patprog p, int fl, int n, char *replstr,
 		    mb_charinit();
 		    for (ioff = 0, t = s, umlen = umltot; t < send; ioff++) {
 			set_pat_start(p, t-s);
-			if (pattrylen(p, t, umlen, 0, &patstralloc, ioff) &&
+			if (PAT_CAN_START(c, t, send) &&
+			    pattrylen(p, t, umlen, 0, &patstralloc, ioff) &&
 			    !n--) {
 			    tmatch = t;
 			    break;
@@ -3172,7 +3409,8 @@ igetmatch(char **sp, Patprog p, int fl, int n, char *replstr,
     /* munge the whole string: no match, so no replstr */
     imd.replstr = NULL;
     imd.repllist = NULL;
-    *sp = get_match_ret(&imd, 0, 0);
+    if (!match_ret_whole(&imd, 0))
+	*sp = get_match_ret(&imd, 0, 0);
     return (fl & SUB_RETFAIL) ? 0 : 1;
 }
 
@@ -3216,21 +3454,7 @@ igetmatch(char **sp, Patprog p, int fl, int n, char *replstr,
 
     /* perform must-match test for complex closures */
     if (p->mustoff)
-    {
-	char *muststr = (char *)p + p->mustoff;
-
-	matched = 0;
-	if (p->patmlen <= uml)
-	{
-	    for (t = s; t <= send - p->patmlen; t++)
-	    {
-		if (!memcmp(muststr, t, p->patmlen)) {
-		    matched = 1;
-		    break;
-		}
-	    }
-	}
-    }
+	matched = pat_has_must(p, s, uml);
 
     /* in case we used the prog before... */
     p->flags &= ~(PAT_NOTSTART|PAT_NOTEND);
@@ -3239,6 +3463,8 @@ igetmatch(char **sp, Patprog p, int fl, int n, char *replstr,
 	int i = matched && pattrylen(p, s, uml, 0, &patstralloc, 0);
 	if (!i)
 	    imd.replstr = NULL;
+	if (match_ret_whole(&imd, i))
+	    return 1;
 	*sp = get_match_ret(&imd, 0, i ? l : 0);
 	if (! **sp && (((fl & SUB_MATCH) && !i) || ((fl & SUB_REST) && i)))
 	    return 0;
@@ -3472,7 +3698,8 @@ igetmatch(char **sp, Patprog p, int fl, int n, char *replstr,
     /* munge the whole string: no match, so no replstr */
     imd.replstr = NULL;
     imd.repllist = NULL;
-    *sp = get_match_ret(&imd, 0, 0);
+    if (!match_ret_whole(&imd, 0))
+	*sp = get_match_ret(&imd, 0, 0);
     return 1;
 }
 
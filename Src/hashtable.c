@@ -707,9 +707,11 @@ static void
 fillcmdnamtable(UNUSED(HashTable ht))
 {
     char **pq;
+    int ev = startup_enter("rehash", "");
  
     for (pq = pathchecked; *pq; pq++)
 	hashdir(pq);
+    startup_leave(ev);
 
     pathchecked = pq;
 }
@@ -1103,6 +1105,31 @@ static struct reswd reswds[] = {
     {{NULL, NULL, 0}, 0}
 };
 
+/*
+ * Incremented whenever an alias or reserved word is added, removed,
+ * enabled or disabled, so that code parsed earlier can tell whether
+ * it might now be parsed differently.
+ */
+
+/**/
+zlong lexgen;
+
+/**/
+static void
+disablelexnode(HashNode hn, int flags)
+{
+    lexgen++;
+    disablehashnode(hn, flags);
+}
+
+/**/
+static void
+enablelexnode(HashNode hn, int flags)
+{
+    lexgen++;
+    enablehashnode(hn, flags);
+}
+
 /* hash table containing the reserved words */
 
 /**/
@@ -1126,8 +1153,8 @@ createreswdtable(void)
     reswdtab->getnode     = gethashnode;
     reswdtab->getnode2    = gethashnode2;
     reswdtab->removenode  = NULL;
-    reswdtab->disablenode = disablehashnode;
-    reswdtab->enablenode  = enablehashnode;
+    reswdtab->disablenode = disablelexnode;
+    reswdtab->enablenode  = enablelexnode;
     reswdtab->freenode    = NULL;
     reswdtab->printnode   = printreswdnode;
 
@@ -1176,6 +1203,22 @@ mod_export HashTable aliastab;
 /**/
 mod_export HashTable sufaliastab;
  
+/**/
+static void
+addaliasnode(HashTable ht, char *nam, void *nodeptr)
+{
+    lexgen++;
+    addhashnode(ht, nam, nodeptr);
+}
+
+/**/
+static HashNode
+removealiasnode(HashTable ht, const char *nam)
+{
+    lexgen++;
+    return removehashnode(ht, nam);
+}
+
 /* Create new hash tables for aliases */
 
 /**/
@@ -1186,12 +1229,12 @@ createaliastable(HashTable ht)
     ht->emptytable  = NULL;
     ht->filltable   = NULL;
     ht->cmpnodes    = strcmp;
-    ht->addnode     = addhashnode;
+    ht->addnode     = addaliasnode;
     ht->getnode     = gethashnode;
     ht->getnode2    = gethashnode2;
-    ht->removenode  = removehashnode;
-    ht->disablenode = disablehashnode;
-    ht->enablenode  = enablehashnode;
+    ht->removenode  = removealiasnode;
+    ht->disablenode = disablelexnode;
+    ht->enablenode  = enablelexnode;
     ht->freenode    = freealiasnode;
     ht->printnode   = printaliasnode;
 }
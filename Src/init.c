@@ -559,11 +559,19 @@ printhelp(void)
     printoptionlist();
 }
 
+/*
+ * Size of the buffer used for standard output.  Builtins such as print
+ * flush it when they finish, so this only decides how much output from
+ * one command goes in each write.
+ */
+
+#define OUTBUFSIZ (65536)
+
 /**/
 mod_export void
 init_io(char *cmd)
 {
-    static char outbuf[BUFSIZ], errbuf[BUFSIZ];
+    static char outbuf[OUTBUFSIZ], errbuf[BUFSIZ];
 
 #ifdef RSH_BUG_WORKAROUND
     int i;
@@ -571,10 +579,10 @@ init_io(char *cmd)
 
 /* stdout, stderr fully buffered */
 #ifdef _IOFBF
-    setvbuf(stdout, outbuf, _IOFBF, BUFSIZ);
+    setvbuf(stdout, outbuf, _IOFBF, OUTBUFSIZ);
     setvbuf(stderr, errbuf, _IOFBF, BUFSIZ);
 #else
-    setbuffer(stdout, outbuf, BUFSIZ);
+    setbuffer(stdout, outbuf, OUTBUFSIZ);
     setbuffer(stderr, errbuf, BUFSIZ);
 #endif
 
@@ -695,11 +703,19 @@ init_io(char *cmd)
 #endif
 }
 
+/* Size of the buffer used for output to the terminal */
+
+#define SHOUTBUFSIZ (32768)
+
 /**/
 mod_export void
 init_shout(void)
 {
-    static char shoutbuf[BUFSIZ];
+    /*
+     * Large enough that a redisplay of a full screen normally goes
+     * to the terminal in a single write when zrefresh() flushes.
+     */
+    static char shoutbuf[SHOUTBUFSIZ];
 #if defined(JOB_CONTROL) && defined(TIOCSETD) && defined(NTTYDISC)
     int ldisc;
 #endif
@@ -720,7 +736,7 @@ init_shout(void)
     shout = fdopen(SHTTY, "w");
 #ifdef _IOFBF
     if (shout)
-	setvbuf(shout, shoutbuf, _IOFBF, BUFSIZ);
+	setvbuf(shout, shoutbuf, _IOFBF, SHOUTBUFSIZ);
 #endif
   
     gettyinfo(&shttyinfo);	/* get tty state */
@@ -1374,7 +1390,7 @@ mod_export enum source_return
 source(char *s)
 {
     Eprog prog;
-    int tempfd = -1, fd, cj;
+    int tempfd = -1, fd, cj, ev;
     zlong oldlineno;
     int oldshst, osubsh, oloops;
     FILE *obshin;
@@ -1391,6 +1407,7 @@ source(char *s)
 	 (tempfd = movefd(open(us, O_RDONLY | O_NOCTTY))) == -1)) {
 	return SOURCE_NOT_FOUND;
     }
+    ev = startup_enter("source", s);
 
     /* save the current shell state */
     fd        = SHIN;            /* store the shell input fd                  */
@@ -1493,6 +1510,7 @@ source(char *s)
     zfree(cmdstack, CMDSTACKSZ);
     cmdstack = ocs;
     cmdsp = ocsp;
+    startup_leave(ev);
 
     return ret;
 }
@@ -1671,6 +1689,195 @@ fallback_compctlread(char *name, UNUSED(char **args), UNUSED(Options ops), UNUSE
 /**/
 mod_export int use_exit_printed;
 
+/*
+ * Phases of startup, timed for the STARTUP_TIMES option.  The time
+ * stored for each is when it finished; the first is when we started.
+ */
+
+static char *startup_phases[] = {
+    NULL, "options", "terminal", "parameters", "signals",
+    "modules", "builtins", "startup files"
+};
+
+#define STARTUP_PHASES (sizeof(startup_phases) / sizeof(*startup_phases))
+
+static struct timeval startup_tv[STARTUP_PHASES];
+
+/*
+ * Events timed during startup for the STARTUP_TIMES option: files
+ * sourced, modules loaded, functions autoloaded and the command hash
+ * table filled.  Events may be nested; depth says how deeply.
+ */
+
+struct startup_event {
+    char *what;
+    char *name;
+    int depth;
+    struct timeval start, end;
+};
+
+static struct startup_event *startup_events;
+static int startup_nevents, startup_maxevents, startup_depth;
+
+/* Set once startup is over, when we stop recording events. */
+
+static int startup_done;
+
+/* Note the end of a startup phase. */
+
+static void
+startup_mark(int phase)
+{
+    struct timezone dummy_tz;
+
+    gettimeofday(startup_tv + phase, &dummy_tz);
+}
+
+/*
+ * Note the start of an event of kind `what' for `name'.  Returns a
+ * handle to pass to startup_leave() when it's over, or -1 if we're
+ * not timing startup.
+ */
+
+/**/
+mod_export int
+startup_enter(char *what, const char *name)
+{
+    struct timezone dummy_tz;
+    struct startup_event *ev;
+
+    if (startup_done || !isset(STARTUPTIMES))
+	return -1;
+    if (startup_nevents == startup_maxevents) {
+	int n = startup_maxevents ? 2 * startup_maxevents : 64;
+
+	startup_events = (struct startup_event *)
+	    zrealloc(startup_events, n * sizeof(*startup_events));
+	startup_maxevents = n;
+    }
+    ev = startup_events + startup_nevents;
+    ev->what = what;
+    ev->name = ztrdup(name);
+    ev->depth = startup_depth++;
+    gettimeofday(&ev->start, &dummy_tz);
+    ev->end = ev->start;
+
+    return startup_nevents++;
+}
+
+/* Note the end of an event started with startup_enter(). */
+
+/**/
+mod_export void
+startup_leave(int handle)
+{
+    struct timezone dummy_tz;
+
+    if (handle < 0)
+	return;
+    gettimeofday(&startup_events[handle].end, &dummy_tz);
+    startup_depth--;
+}
+
+/* Milliseconds between two times */
+
+static double
+startup_ms(struct timeval *from, struct timeval *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1e3 +
+	(to->tv_usec - from->tv_usec) / 1e3;
+}
+
+/* Output a string quoted for JSON. */
+
+static void
+startup_json_string(FILE *out, char *s)
+{
+    putc('"', out);
+    for (s = unmeta(s); *s; s++) {
+	if (*s == '"' || *s == '\\')
+	    fprintf(out, "\\%c", *s);
+	else if (STOUC(*s) < 32)
+	    fprintf(out, "\\u%04x", STOUC(*s));
+	else
+	    putc(*s, out);
+    }
+    putc('"', out);
+}
+
+/* Output a complete event for the trace file. */
+
+static void
+startup_json_event(FILE *out, char *what, char *name,
+		   struct timeval *start, struct timeval *end)
+{
+    fputs(",\n{\"name\":", out);
+    startup_json_string(out, name);
+    fprintf(out, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.0f,\"dur\":%.0f,"
+	    "\"pid\":%ld,\"tid\":1}", what,
+	    startup_ms(startup_tv, start) * 1e3,
+	    startup_ms(start, end) * 1e3, (long)mypid);
+}
+
+/*
+ * Report the times taken by startup: on standard error, or as a
+ * trace in Chrome's JSON format to the file $ZSH_STARTUP_TRACE.
+ */
+
+static void
+startup_report(void)
+{
+    struct startup_event *ev;
+    char *file = getsparam("ZSH_STARTUP_TRACE");
+    FILE *out;
+    int i;
+
+    if (file && *file) {
+	if (!(out = fopen(unmeta(file), "w"))) {
+	    zwarn("can't write startup trace %s: %e", file, errno);
+	    return;
+	}
+	fprintf(out, "{\"traceEvents\":[\n{\"name\":\"process_name\","
+		"\"ph\":\"M\",\"pid\":%ld,\"tid\":1,"
+		"\"args\":{\"name\":\"zsh\"}}", (long)mypid);
+	for (i = 1; i < (int)STARTUP_PHASES; i++)
+	    startup_json_event(out, "phase", startup_phases[i],
+			       startup_tv + i - 1, startup_tv + i);
+	for (i = 0, ev = startup_events; i < startup_nevents; i++, ev++)
+	    startup_json_event(out, ev->what, ev->name, &ev->start, &ev->end);
+	fputs("\n]}\n", out);
+	fclose(out);
+	return;
+    }
+    for (i = 1; i < (int)STARTUP_PHASES; i++)
+	fprintf(stderr, "%9.3f %s\n",
+		startup_ms(startup_tv + i - 1, startup_tv + i),
+		startup_phases[i]);
+    fprintf(stderr, "%9.3f total\n",
+	    startup_ms(startup_tv, startup_tv + STARTUP_PHASES - 1));
+    for (i = 0, ev = startup_events; i < startup_nevents; i++, ev++)
+	fprintf(stderr, "%9.3f %*s%s%s%s\n", startup_ms(&ev->start, &ev->end),
+		2 * ev->depth, "", ev->what, *ev->name ? " " : "",
+		unmeta(ev->name));
+    fflush(stderr);
+}
+
+/* Stop timing startup, and free what we recorded. */
+
+static void
+startup_finish(void)
+{
+    int i;
+
+    for (i = 0; i < startup_nevents; i++)
+	zsfree(startup_events[i].name);
+    if (startup_events)
+	zfree(startup_events, startup_maxevents * sizeof(*startup_events));
+    startup_events = NULL;
+    startup_nevents = startup_maxevents = 0;
+    startup_done = 1;
+}
+
 /*
  * This is real main entry point. This has to be mod_export'ed
  * so zsh.exe can found it on Cygwin
@@ -1683,6 +1890,7 @@ zsh_main(UNUSED(int argc), char **argv)
     char **t, *runscript = NULL, *zsh_name;
     char *cmd;			/* argument to -c */
     int t0;
+    startup_mark(0);
 #ifdef USE_LOCALE
     setlocale(LC_ALL, "");
 #endif
@@ -1729,15 +1937,25 @@ zsh_main(UNUSED(int argc), char **argv)
     /* sets emulation, LOGINSHELL, PRIVILEGED, ZLE, INTERACTIVE,
      * SHINSTDIN and SINGLECOMMAND */ 
     parseargs(zsh_name, argv, &runscript, &cmd);
+    startup_mark(1);
 
     SHTTY = -1;
     init_io(cmd);
+    startup_mark(2);
     setupvals(cmd, runscript, zsh_name);
+    startup_mark(3);
 
     init_signals();
+    startup_mark(4);
     init_bltinmods();
+    startup_mark(5);
     init_builtins();
+    startup_mark(6);
     run_init_scripts();
+    startup_mark(7);
+    if (isset(STARTUPTIMES))
+	startup_report();
+    startup_finish();
     setupshin(runscript);
     init_misc(cmd, zsh_name);
 
@@ -150,7 +150,12 @@ shingetline(void)
 	/* Can't fgets() here because we need to accept '\0' bytes */
 	do {
 	    errno = 0;
+#ifdef HAVE_GETC_UNLOCKED
+	    /* The shell has only the one thread, so needs no locking */
+	    c = getc_unlocked(bshin);
+#else
 	    c = fgetc(bshin);
+#endif
 	} while (c < 0 && errno == EINTR);
 	if (c < 0 || c == '\n') {
 	    winch_block();
@@ -406,6 +411,31 @@ inputsetline(char *str, int flags)
     unqueue_signals();
 }
 
+/*
+ * Look at the characters left in the current input buffer without
+ * reading them; the number is returned in *lenp.  The lexer uses this
+ * to take runs of ordinary characters in one go, calling inskip() for
+ * the ones it has used.  These must not include tokens, which ingetc()
+ * would skip, or newlines, which it would count.
+ */
+
+/**/
+char *
+inpeekbuf(int *lenp)
+{
+    *lenp = lexstop ? 0 : inbufleft;
+    return inbufptr;
+}
+
+/**/
+void
+inskip(int n)
+{
+    inbufptr += n;
+    inbufleft -= n;
+    inbufct -= n;
+}
+
 /*
  * Backup one character of the input.
  * The last character can always be backed up, provided we didn't just
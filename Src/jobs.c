@@ -2109,6 +2109,33 @@ static int getbgstatus(pid_t pid)
     return -1;
 }
 
+/*
+ * Return the status of child pid in the form used for $? if it has
+ * finished, -1 if it is still running or stopped, or -2 if it is not
+ * a child we know about.  Unlike getbgstatus(), this leaves any
+ * recorded status for wait to pick up.  Signals should be queued.
+ */
+
+/**/
+mod_export int
+childstatus(pid_t pid)
+{
+    LinkNode node;
+    Job jn;
+    Process pn;
+
+    if (findproc(pid, &jn, &pn, 0) || findproc(pid, &jn, &pn, 1))
+	return -1;
+    if (bgstatus_list) {
+	for (node = firstnode(bgstatus_list); node; incnode(node)) {
+	    Bgstatus bgstatus_entry = (Bgstatus)getdata(node);
+	    if (bgstatus_entry->pid == pid)
+		return bgstatus_entry->status;
+	}
+    }
+    return -2;
+}
+
 /* bg, disown, fg, jobs, wait: most of the job control commands are     *
  * here.  They all take the same type of argument.  Exception: wait can *
  * take a pid or a job specifier, whereas the others only work on jobs. */
@@ -405,6 +405,10 @@ ctxtlex(void)
 
 static unsigned char lexact1[256], lexact2[256], lextok2[256];
 
+/* Characters dquote_parse() treats specially, apart from its end */
+
+static unsigned char lexdqspecial[256];
+
 /**/
 void
 initlextabs(void)
@@ -412,6 +416,7 @@ initlextabs(void)
     int t0;
     static char *lx1 = "\\q\n;!&|(){}[]<>";
     static char *lx2 = ";)|$[]~({}><=\\\'\"`,-!";
+    static char *lxdq = "\\\n$}`'()[]\"";
 
     for (t0 = 0; t0 != 256; t0++) {
        lexact1[t0] = LX1_OTHER;
@@ -432,6 +437,8 @@ initlextabs(void)
     lextok2['~'] = Tilde;
     lextok2['#'] = Pound;
     lextok2['^'] = Hat;
+    for (t0 = 0; lxdq[t0]; t0++)
+	lexdqspecial[STOUC(lxdq[t0])] = 1;
 }
 
 /* initialize lexical state */
@@ -465,6 +472,59 @@ add(int c)
     }
 }
 
+/*
+ * Add a run of characters that need no attention from the caller
+ * straight from the input buffer to the token, returning how many
+ * there were.  With dq set the characters are those that dquote_parse()
+ * passes through unchanged, else those that gettokstr() only translates
+ * by lextok2.  This is only possible when reading a character has no
+ * side effects, i.e. when history isn't being recorded or expanded.
+ */
+
+/**/
+static int
+addrun(int dq, int endchar)
+{
+    int len, n, c;
+    char *ptr;
+
+    if (hgetc != ingetc)
+	return 0;
+    ptr = inpeekbuf(&len);
+    for (n = 0; n < len; n++) {
+	c = STOUC(ptr[n]);
+	if (imeta(c) || (dq ? (c == endchar || lexdqspecial[c]) :
+			 (inblank(c) || lexact2[c] != LX2_OTHER)))
+	    break;
+    }
+    if (!n)
+	return 0;
+    if (lexbuf.len + n >= lexbuf.siz) {
+	int newbsiz = lexbuf.siz;
+
+	while (lexbuf.len + n >= newbsiz)
+	    newbsiz *= 2;
+	tokstr = (char *)hrealloc(tokstr, lexbuf.siz, newbsiz);
+	lexbuf.ptr = tokstr + lexbuf.len;
+	memset(lexbuf.ptr, 0, newbsiz - lexbuf.siz);
+	lexbuf.siz = newbsiz;
+    }
+    if (dq)
+	memcpy(lexbuf.ptr, ptr, n);
+    else {
+	for (c = 0; c < n; c++)
+	    lexbuf.ptr[c] = lextok2[STOUC(ptr[c])];
+    }
+    lexbuf.ptr += n;
+    lexbuf.len += n;
+    if (lex_add_raw) {
+	for (c = 0; c < n; c++)
+	    zshlex_raw_add(STOUC(ptr[c]));
+    }
+    inskip(n);
+    return n;
+}
+
 #define SETPARBEGIN {							\
 	if ((lexflags & LEXFLAGS_ZLE) && !(inbufflags & INP_ALIAS) &&	\
 	    zlemetacs >= zlemetall+1-inbufct)				\
@@ -1383,6 +1443,10 @@ gettokstr(int c, int sub)
                c = '!';
        }
        add(c);
+       if ((e = addrun(0, 0))) {
+	   fdpar = 0;
+	   intpos = intpos > e ? intpos - e : 0;
+       }
        c = hgetc();
 	if (intpos)
 	    intpos--;
@@ -1559,6 +1623,7 @@ dquote_parse(char endchar, int sub)
 	if (err || lexstop)
 	    break;
 	add(c);
+	addrun(1, STOUC(endchar));
     }
     if (intick == 2)
 	ALLOWHIST
@@ -56,6 +56,7 @@ execfor(Estate state, int do_exec)
     char *name, *str, *cond = NULL, *advance = NULL;
     zlong val = 0;
     LinkList vars = NULL, args = NULL;
+    Rangeiter iter = NULL;
     int old_simple_pline = simple_pline;
 
     /* See comments in execwhile() */
@@ -95,7 +96,9 @@ execfor(Estate state, int do_exec)
 		return 0;
 	    }
 	    if (htok) {
-		execsubst(args);
+		/* Don't expand ranges like {1..1000000} all at once */
+		if (!(iter = newrangeiter(args)))
+		    execsubst(args);
 		if (errflag) {
 		    state->pc = end;
 		    simple_pline = old_simple_pline;
@@ -152,7 +155,8 @@ execfor(Estate state, int do_exec)
 	    for (node = firstnode(vars); node; incnode(node))
 	    {
 		name = (char *)getdata(node);
-		if (!args || !(str = (char *) ugetnode(args)))
+		if (!args || !(str = iter ? rangeiternext(iter) :
+			       (char *) ugetnode(args)))
 		{
 		    if (count) { 
 			str = "";
@@ -172,7 +176,8 @@ execfor(Estate state, int do_exec)
 		break;
 	}
 	state->pc = loop;
-	execlist(state, 1, do_exec && args && empty(args));
+	execlist(state, 1, do_exec && args &&
+		 (iter ? rangeiterdone(iter) : empty(args)));
 	if (breaks) {
 	    breaks--;
 	    if (breaks || !contflag)
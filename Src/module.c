@@ -1027,7 +1027,7 @@ checkaddparam(const char *nam, int opt_i)
 {
     Param pm;
 
-    if (!(pm = (Param) gethashnode2(paramtab, nam)))
+    if (!(pm = (Param) getparamnode2(paramtab, nam)))
 	return 0;
 
     if (pm->level || !(pm->node.flags & PM_AUTOLOAD)) {
@@ -2195,6 +2195,17 @@ modname_ok(char const *p)
 /**/
 mod_export int
 load_module(char const *name, Feature_enables enablesarr, int silent)
+{
+    int ev = startup_enter("module", name), ret;
+
+    ret = load_module_now(name, enablesarr, silent);
+    startup_leave(ev);
+    return ret;
+}
+
+/**/
+static int
+load_module_now(char const *name, Feature_enables enablesarr, int silent)
 {
     Module m;
     void *handle = NULL;
@@ -250,6 +250,7 @@ static struct optname optns[] = {
 {{NULL, "singlecommand",      OPT_SPECIAL},		 SINGLECOMMAND},
 {{NULL, "singlelinezle",      OPT_KSH},			 SINGLELINEZLE},
 {{NULL, "sourcetrace",        0},			 SOURCETRACE},
+{{NULL, "startuptimes",       0},			 STARTUPTIMES},
 {{NULL, "sunkeyboardhack",    0},			 SUNKEYBOARDHACK},
 {{NULL, "transientrprompt",   0},			 TRANSIENTRPROMPT},
 {{NULL, "trapsasync",	      0},			 TRAPSASYNC},
@@ -115,6 +115,7 @@ zlong zsh_funcnest =
     ;
 
 /**/
+mod_export
 zlong lineno,		/* $LINENO      */
      zoptind,		/* $OPTIND      */
      shlvl;		/* $SHLVL       */
@@ -343,6 +344,8 @@ IPDEF4("HISTCMD", &curhist),
 IPDEF4("LINENO", &lineno),
 IPDEF4("PPID", &ppid),
 IPDEF4("ZSH_SUBSHELL", &zsh_subshell),
+IPDEF4("ZSH_EVAL_CACHE_HITS", &evalcachehits),
+IPDEF4("ZSH_EVAL_CACHE_MISSES", &evalcachemisses),
 
 #define IPDEF5(A,B,F) {{NULL,A,PM_INTEGER|PM_SPECIAL},BR((void *)B),GSU(F),10,0,NULL,NULL,NULL,0}
 #define IPDEF5U(A,B,F) {{NULL,A,PM_INTEGER|PM_SPECIAL|PM_UNSET},BR((void *)B),GSU(F),10,0,NULL,NULL,NULL,0}
@@ -493,7 +496,7 @@ newparamtable(int size, char const *name)
     ht->cmpnodes    = strcmp;
     ht->addnode     = addhashnode;
     ht->getnode     = getparamnode;
-    ht->getnode2    = gethashnode2;
+    ht->getnode2    = getparamnode2;
     ht->removenode  = removehashnode;
     ht->disablenode = NULL;
     ht->enablenode  = NULL;
@@ -503,11 +506,30 @@ newparamtable(int size, char const *name)
     return ht;
 }
 
+/*
+ * Look up a parameter, importing it from the environment if need be.
+ * Unlike getparamnode(), this doesn't autoload the parameter, and
+ * unlike ht->getnode2() it can't be replaced by a module.
+ */
+
+/**/
+mod_export HashNode
+getparamnode2(HashTable ht, const char *nam)
+{
+    HashNode hn = gethashnode2(ht, nam);
+
+#ifdef USE_SET_UNSET_ENV
+    if (!hn && ht == realparamtab && importwaitingenv(nam))
+	hn = gethashnode2(ht, nam);
+#endif
+    return hn;
+}
+
 /**/
 static HashNode
 getparamnode(HashTable ht, const char *nam)
 {
-    HashNode hn = gethashnode2(ht, nam);
+    HashNode hn = getparamnode2(ht, nam);
     Param pm = (Param) hn;
 
     if (pm && pm->u.str && (pm->node.flags & PM_AUTOLOAD)) {
@@ -590,6 +612,11 @@ static char *scanstr;
 static char **paramvals;
 static Param foundparam;
 
+/* Literal text any key or value matching scanprog must start with */
+
+static char *scanpfx;
+static int scanpfxlen;
+
 /**/
 static void
 scanparamvals(HashNode hn, int flags)
@@ -609,7 +636,9 @@ scanparamvals(HashNode hn, int flags)
 
 	if (!(prog = patcompile(tmp, 0, NULL)) || !pattry(prog, scanstr))
 	    return;
-    } else if ((flags & SCANPM_MATCHKEY) && !pattry(scanprog, v.pm->node.nam)) {
+    } else if ((flags & SCANPM_MATCHKEY) &&
+	       ((scanpfx && strncmp(v.pm->node.nam, scanpfx, scanpfxlen)) ||
+		!pattry(scanprog, v.pm->node.nam))) {
 	return;
     }
     foundparam = v.pm;
@@ -624,7 +653,9 @@ scanparamvals(HashNode hn, int flags)
     v.end = -1;
     paramvals[numparamvals] = getstrvalue(&v);
     if (flags & SCANPM_MATCHVAL) {
-	if (pattry(scanprog, paramvals[numparamvals])) {
+	if ((!scanpfx ||
+	     !strncmp(paramvals[numparamvals], scanpfx, scanpfxlen)) &&
+	    pattry(scanprog, paramvals[numparamvals])) {
 	    numparamvals += ((flags & SCANPM_WANTVALS) ? 1 :
 			     !(flags & SCANPM_WANTKEYS));
 	} else if (flags & SCANPM_WANTKEYS)
@@ -634,20 +665,73 @@ scanparamvals(HashNode hn, int flags)
     foundparam = NULL;
 }
 
+/*
+ * Get the keys and/or values of the elements of an ordinary hash
+ * table, i.e. one held in memory rather than generated as it is
+ * scanned.  The elements are read straight from the table in one
+ * pass.  If we're only keeping the elements that match a pattern we
+ * don't know how many there will be, so the array grows as needed;
+ * a key that is a plain string is simply looked up.
+ */
+
+/**/
+static void
+hashvalarr(HashTable ht, int flags, int whole)
+{
+    HashNode hn;
+    unsigned size;
+    int i;
+
+    if (whole && (flags & SCANPM_MATCHKEY)) {
+	paramvals = (char **) zhalloc(3 * sizeof(char *));
+	if ((hn = gethashnode2(ht, scanpfx)) && !(hn->flags & PM_UNSET))
+	    scanparamvals(hn, flags);
+	return;
+    }
+    if (flags & (SCANPM_MATCHKEY|SCANPM_MATCHVAL|SCANPM_KEYMATCH))
+	size = 16;
+    else
+	size = ht->ct * (((flags & SCANPM_WANTKEYS) &&
+			  (flags & SCANPM_WANTVALS)) ? 2 : 1) + 1;
+    paramvals = (char **) zhalloc(size * sizeof(char *));
+    for (i = 0; i < ht->hsize; i++)
+	for (hn = ht->nodes[i]; hn; hn = hn->next) {
+	    if (hn->flags & PM_UNSET)
+		continue;
+	    if (numparamvals + 3 > size) {
+		paramvals = (char **) hrealloc((char *) paramvals,
+					       size * sizeof(char *),
+					       2 * size * sizeof(char *));
+		size *= 2;
+	    }
+	    scanparamvals(hn, flags);
+	}
+}
+
 /**/
 char **
 paramvalarr(HashTable ht, int flags)
 {
+    int whole = 0;
+
     DPUTS((flags & (SCANPM_MATCHKEY|SCANPM_MATCHVAL)) && !scanprog,
 	  "BUG: scanning hash without scanprog set");
     numparamvals = 0;
-    if (ht)
-	scanhashtable(ht, 0, 0, PM_UNSET, scancountparams, flags);
-    paramvals = (char **) zhalloc((numparamvals + 1) * sizeof(char *));
-    if (ht) {
-	numparamvals = 0;
-	scanhashtable(ht, 0, 0, PM_UNSET, scanparamvals, flags);
+    scanpfx = NULL;
+    if (ht && (flags & (SCANPM_MATCHKEY|SCANPM_MATCHVAL)))
+	scanpfx = patliteralprefix(scanprog, &scanpfxlen, &whole);
+    if (ht && !ht->scantab)
+	hashvalarr(ht, flags, whole);
+    else {
+	if (ht)
+	    scanhashtable(ht, 0, 0, PM_UNSET, scancountparams, flags);
+	paramvals = (char **) zhalloc((numparamvals + 1) * sizeof(char *));
+	if (ht) {
+	    numparamvals = 0;
+	    scanhashtable(ht, 0, 0, PM_UNSET, scanparamvals, flags);
+	}
     }
+    scanpfx = NULL;
     paramvals[numparamvals] = 0;
     return paramvals;
 }
@@ -758,6 +842,181 @@ static int dontimport(int flags)
     return 0;
 }
 
+/*
+ * Import an environment string as a parameter, unless it names a
+ * parameter that shouldn't be imported.  Returns the parameter.
+ */
+
+static Param
+importenv(char *env)
+{
+    char *iname, *ivalue;
+    Param pm;
+
+    if (!split_env_string(env, &iname, &ivalue) ||
+	idigit(*iname) || !isident(iname) || strchr(iname, '['))
+	return NULL;
+    /*
+     * Parameters that aren't already in the parameter table
+     * aren't special to the shell, so it's always OK to
+     * import.  Otherwise, check parameter flags.
+     */
+    if ((!(pm = (Param) paramtab->getnode(paramtab, iname)) ||
+	 !dontimport(pm->node.flags)) &&
+	(pm = assignsparam(iname, metafy(ivalue, -1, META_DUP),
+			   ASSPM_ENV_IMPORT))) {
+	pm->node.flags |= PM_EXPORTED;
+	if (pm->node.flags & PM_SPECIAL)
+	    pm->env = mkenvstr (pm->node.nam,
+				getsparam(pm->node.nam), pm->node.flags);
+	else
+	    pm->env = ztrdup(env);
+	return pm;
+    }
+    return NULL;
+}
+
+/**/
+#ifdef USE_SET_UNSET_ENV
+
+/*
+ * Environment variables not yet imported as parameters.  With many
+ * variables in the environment, most of them never used, importing
+ * them all makes every shell start more slowly, so those that don't
+ * name a parameter the shell sets up itself wait here until they are
+ * looked up or the parameter table is listed.  This is a hash table
+ * with open addressing of the strings in environ; once a string has
+ * been imported its entry is set to envdone.
+ */
+
+static char **envwait;
+static int envwaitsize, envwaitct;
+static char envdone[] = "";
+
+/* Parameters set up before the environment is imported */
+
+static char *preset_params[] = {
+    "MAILCHECK", "LOGCHECK", "KEYTIMEOUT", "LISTMAX", "TMPPREFIX",
+    "TIMEFMT", "WATCHFMT", "HOST", "LOGNAME", NULL
+};
+
+/* Hash the name at the start of an environment string. */
+
+static unsigned int
+envhash(const char *s)
+{
+    unsigned int hashval = 0;
+
+    while (*s && *s != '=')
+	hashval += (hashval << 5) + STOUC(*s++);
+    return hashval;
+}
+
+/* Find the entry for a name, or the empty one where it would go. */
+
+static char **
+envwaitslot(const char *nam, int len)
+{
+    int i = envhash(nam) & (envwaitsize - 1);
+    char *env;
+
+    while ((env = envwait[i])) {
+	if (env != envdone && !strncmp(env, nam, len) && env[len] == '=')
+	    break;
+	i = (i + 1) & (envwaitsize - 1);
+    }
+    return envwait + i;
+}
+
+/* Put the strings in environ into the table of those waiting. */
+
+static void
+waitenv(void)
+{
+    char **envp, **slot, *s;
+    int n = arrlen(environ);
+
+    for (envwaitsize = 16; envwaitsize < 2 * n; envwaitsize <<= 1)
+	;
+    envwait = (char **) zshcalloc(envwaitsize * sizeof(char *));
+    for (envp = environ; *envp; envp++) {
+	for (s = *envp; *s && *s != '='; s++)
+	    ;
+	if (s == *envp || !*s)
+	    continue;
+	if (!*(slot = envwaitslot(*envp, s - *envp)))
+	    envwaitct++;
+	/* If a name appears twice the later value wins, as on import. */
+	*slot = *envp;
+    }
+}
+
+/* Import a waiting environment string from its entry. */
+
+static Param
+importwaiting(char **slot)
+{
+    HashTable opt = paramtab;
+    int oae = opts[ALLEXPORT], one = noerrs, oef = errflag;
+    char *env = *slot;
+    Param pm;
+
+    *slot = envdone;
+    if (!--envwaitct) {
+	zfree(envwait, envwaitsize * sizeof(char *));
+	envwait = NULL;
+	envwaitsize = 0;
+    }
+    paramtab = realparamtab;
+    opts[ALLEXPORT] = 0;
+    noerrs = 2;
+    errflag = 0;
+    pushheap();
+    pm = importenv(env);
+    popheap();
+    errflag = oef;
+    noerrs = one;
+    opts[ALLEXPORT] = oae;
+    paramtab = opt;
+
+    return pm;
+}
+
+/* Import the variable nam from the environment if it's waiting. */
+
+/**/
+static Param
+importwaitingenv(const char *nam)
+{
+    char **slot;
+
+    if (!envwaitct || !*(slot = envwaitslot(nam, strlen(nam))))
+	return NULL;
+    return importwaiting(slot);
+}
+
+/**/
+#endif
+
+/*
+ * Import all environment variables that are still waiting.  This
+ * must be called before scanning the parameter table for anything
+ * other than local parameters.
+ */
+
+/**/
+mod_export void
+importallenv(void)
+{
+#ifdef USE_SET_UNSET_ENV
+    int i;
+
+    for (i = 0; envwaitct && i < envwaitsize; i++)
+	if (envwait[i] && envwait[i] != envdone)
+	    importwaiting(envwait + i);
+#endif
+}
+
 /* Set up parameter hash table.  This will add predefined  *
  * parameter entries as well as setting up parameter table *
  * entries for environment variables we inherit.           */
@@ -774,8 +1033,11 @@ createparamtable(void)
 #ifndef USE_SET_UNSET_ENV
     char **envp;
 #endif
-    char **envp2, **sigptr, **t;
-    char buf[50], *str, *iname, *ivalue, *hostnam;
+#ifndef USE_SET_UNSET_ENV
+    char **envp2;
+#endif
+    char **sigptr, **t;
+    char buf[50], *str, *hostnam;
     int  oae = opts[ALLEXPORT];
 #ifdef HAVE_UNAME
     struct utsname unamebuf;
@@ -840,43 +1102,30 @@ createparamtable(void)
     environ = new_environ;
 #endif
 
+#ifdef USE_SET_UNSET_ENV
+    /*
+     * Only variables for parameters the shell has already set up
+     * are imported now; the rest wait until they're needed.
+     */
+    waitenv();
+    for (ip = special_params; ip->node.nam; ip++)
+	importwaitingenv(ip->node.nam);
+    for (ip = special_params_sh; ip->node.nam; ip++)
+	importwaitingenv(ip->node.nam);
+    for (t = preset_params; *t; t++)
+	importwaitingenv(*t);
+#else
     /* Use heap allocation to avoid many small alloc/free calls */
     pushheap();
 
     /* Now incorporate environment variables we are inheriting *
      * into the parameter hash table. Copy them into dynamic   *
      * memory so that we can free them if needed               */
-    for (
-#ifndef USE_SET_UNSET_ENV
-	envp = 
-#endif
-	    envp2 = environ; *envp2; envp2++) {
-	if (split_env_string(*envp2, &iname, &ivalue)) {
-	    if (!idigit(*iname) && isident(iname) && !strchr(iname, '[')) {
-		/*
-		 * Parameters that aren't already in the parameter table
-		 * aren't special to the shell, so it's always OK to
-		 * import.  Otherwise, check parameter flags.
-		 */
-		if ((!(pm = (Param) paramtab->getnode(paramtab, iname)) ||
-		     !dontimport(pm->node.flags)) &&
-		    (pm = assignsparam(iname, metafy(ivalue, -1, META_DUP),
-				       ASSPM_ENV_IMPORT))) {
-		    pm->node.flags |= PM_EXPORTED;
-		    if (pm->node.flags & PM_SPECIAL)
-			pm->env = mkenvstr (pm->node.nam,
-					    getsparam(pm->node.nam), pm->node.flags);
-		    else
-			pm->env = ztrdup(*envp2);
-#ifndef USE_SET_UNSET_ENV
-		    *envp++ = pm->env;
-#endif
-		}
-	    }
-	}
+    for (envp = envp2 = environ; *envp2; envp2++) {
+	if ((pm = importenv(*envp2)))
+	    *envp++ = pm->env;
     }
     popheap();
-#ifndef USE_SET_UNSET_ENV
     *envp = NULL;
 #endif
     opts[ALLEXPORT] = oae;
@@ -975,8 +1224,8 @@ createparam(char *name, int flags)
 
     if (name != nulstring) {
 	oldpm = (Param) (paramtab == realparamtab ?
-			 /* gethashnode2() for direct table read */
-			 gethashnode2(paramtab, name) :
+			 /* getparamnode2() for direct table read */
+			 getparamnode2(paramtab, name) :
 			 paramtab->getnode(paramtab, name));
 
 	DPUTS(oldpm && oldpm->level > locallevel,
@@ -2378,13 +2627,15 @@ getarrvalue(Value v)
     }
     else {
         /* Copy to a point before the end of the source array:
-         * arrdup_max will copy at most v->end - v->start elements,
+         * arrshare_max will copy at most v->end - v->start elements,
          * starting from v->start element. Original code said:
 	 *  s[v->end - v->start] = NULL
          * which means that there are exactly the same number of
          * elements as the value of the above *0-based* index.
+	 * As for the whole array above, the strings are the
+	 * parameter's own; callers copy them if they need to.
          */
-	s = arrdup_max(s + v->start, v->end - v->start);
+	s = arrshare_max(s + v->start, v->end - v->start);
     }
 
     return s;
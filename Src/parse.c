@@ -3564,7 +3564,8 @@ zwcstat(char *filename, struct stat *buf)
         FuncDump f;
     
 	for (f = dumps; f; f = f->next) {
-	    if (!strncmp(filename, f->filename, strlen(f->filename)) &&
+	    if (f->count &&
+		!strncmp(filename, f->filename, strlen(f->filename)) &&
 		!fstat(f->fd, buf))
 		return 0;
 	}
@@ -3612,6 +3613,22 @@ load_dump_file(char *dump, struct stat *sbuf, int other, int len)
     if (fd == -1)
 	return;
 
+    /*
+     * A mapping nothing refers to under the same name is for a file
+     * that has since been replaced.
+     */
+    {
+	FuncDump p, *q;
+
+	for (q = &dumps; (p = *q); ) {
+	    if (!p->count && !strcmp(p->filename, dump)) {
+		*q = p->next;
+		freedump(p);
+	    } else
+		q = &p->next;
+	}
+    }
+
     if ((addr = (Wordcode) mmap(NULL, mlen, PROT_READ, MAP_SHARED, fd, off)) ==
 	((Wordcode) -1)) {
 	close(fd);
@@ -3640,10 +3657,132 @@ load_dump_file(char *dump, struct stat *sbuf, int other, int len)
 /**/
 #endif
 
+/*
+ * Cache of the names of files in directories searched for autoloaded
+ * functions, so that a directory which doesn't contain a function's
+ * file can be passed over without looking for the file.  An entry is
+ * rebuilt if the directory's status change time moves, which it does
+ * whenever a file is added, removed or renamed.
+ */
+
+struct fpdir {
+    struct hashnode node;
+    dev_t dev;
+    ino_t ino;
+    time_t ctime;
+#ifdef GET_ST_CTIME_NSEC
+    long ctime_nsec;
+#endif
+    HashTable names;		/* files in the directory */
+};
+
+typedef struct fpdir *Fpdir;
+
+static HashTable fpdirtab;
+
+/**/
+static void
+freefpname(HashNode hn)
+{
+    zsfree(hn->nam);
+    zfree(hn, sizeof(struct hashnode));
+}
+
+/**/
+static void
+freefpdir(HashNode hn)
+{
+    Fpdir fd = (Fpdir) hn;
+
+    zsfree(fd->node.nam);
+    deletehashtable(fd->names);
+    zfree(fd, sizeof(struct fpdir));
+}
+
+/**/
+static HashTable
+newfptable(int size, char const *name, FreeNodeFunc freenode)
+{
+    HashTable ht = newhashtable(size, name, NULL);
+
+    ht->hash        = hasher;
+    ht->emptytable  = emptyhashtable;
+    ht->filltable   = NULL;
+    ht->cmpnodes    = strcmp;
+    ht->addnode     = addhashnode;
+    ht->getnode     = gethashnode2;
+    ht->getnode2    = gethashnode2;
+    ht->removenode  = removehashnode;
+    ht->disablenode = NULL;
+    ht->enablenode  = NULL;
+    ht->freenode    = freenode;
+    ht->printnode   = NULL;
+
+    return ht;
+}
+
+/*
+ * Return 0 if the directory dir from fpath certainly has no file
+ * for the function s, either plain or compiled, else 1.
+ * A digest file dir.zwc is not covered by this.
+ */
+
+/**/
+int
+fpdirhas(char *dir, char *s)
+{
+    struct stat st;
+    Fpdir fd;
+    DIR *d;
+    char *fn;
+
+    /* The current directory changes, so don't remember it */
+    if (*dir != '/')
+	return 1;
+    if (stat(unmeta(dir), &st) || !S_ISDIR(st.st_mode))
+	return 0;
+    if (!fpdirtab)
+	fpdirtab = newfptable(31, "fpdirtab", freefpdir);
+    fd = (Fpdir) fpdirtab->getnode2(fpdirtab, dir);
+    if (fd && (fd->dev != st.st_dev || fd->ino != st.st_ino ||
+#ifdef GET_ST_CTIME_NSEC
+	       fd->ctime_nsec != GET_ST_CTIME_NSEC(st) ||
+#endif
+	       fd->ctime != st.st_ctime)) {
+	fpdirtab->freenode(fpdirtab->removenode(fpdirtab, dir));
+	fd = NULL;
+    }
+    if (!fd) {
+	/*
+	 * A change later in the same second might not alter the
+	 * time, so don't trust a directory that has only just been
+	 * changed.
+	 */
+	if (st.st_ctime >= time(NULL) || !(d = opendir(unmeta(dir))))
+	    return 1;
+	fd = (Fpdir) zshcalloc(sizeof(struct fpdir));
+	fd->dev = st.st_dev;
+	fd->ino = st.st_ino;
+	fd->ctime = st.st_ctime;
+#ifdef GET_ST_CTIME_NSEC
+	fd->ctime_nsec = GET_ST_CTIME_NSEC(st);
+#endif
+	fd->names = newfptable(63, "fpnames", freefpname);
+	while ((fn = zreaddir(d, 1)))
+	    fd->names->addnode(fd->names, ztrdup(fn),
+			       zshcalloc(sizeof(struct hashnode)));
+	closedir(d);
+	fpdirtab->addnode(fpdirtab, ztrdup(dir), fd);
+    }
+    return fd->names->getnode2(fd->names, s) ||
+	fd->names->getnode2(fd->names, dyncat(s, FD_EXT));
+}
+
 /* Try to load a function from one of the possible wordcode files for it.
  * The first argument is a element of $fpath, the second one is the name
  * of the function searched and the last one is the possible name for the
- * uncompiled function file (<path>/<func>). */
+ * uncompiled function file (<path>/<func>), or NULL if the directory is
+ * known to contain neither that nor its compiled version. */
 
 /**/
 Eprog
@@ -3661,11 +3800,13 @@ try_dump_file(char *path, char *name, char *file, int *ksh, int test_only)
 	return prog;
     }
     dig = dyncat(path, FD_EXT);
-    wc = dyncat(file, FD_EXT);
-
     rd = zwcstat(dig, &std);
-    rc = stat(wc, &stc);
-    rn = stat(file, &stn);
+    if (file) {
+	wc = dyncat(file, FD_EXT);
+	rc = stat(wc, &stc);
+	rn = stat(file, &stn);
+    } else
+	rc = rn = -1;
 
     /* See if there is a digest file for the directory, it is younger than
      * both the uncompiled function file and its compiled version (or they
@@ -3729,6 +3870,189 @@ try_source_file(char *file)
     return NULL;
 }
 
+/*
+ * Compiled copies of autoloaded files are kept in the directory named
+ * by $ZCOMPILE_CACHE, if that is set.  The copy of /dir/file is
+ * dir/file-XXXXXXXX.zwc below the cache directory, where XXXXXXXX is a
+ * hash of the options, aliases and disabled reserved words in effect,
+ * since these can change the way the file is parsed.
+ *
+ * Sourced files aren't cached: they are parsed and run a command at a
+ * time, so aliases they define apply to the rest of the file, which
+ * they wouldn't if the whole file were compiled first.
+ */
+
+/* Hash value being accumulated by cache_hash() */
+
+static unsigned int cachehash;
+
+/*
+ * Hashes of the disabled reserved words and of the aliases, which are
+ * only worked out again when lexgen says they have changed.
+ */
+
+static unsigned int reswdhash, aliashash;
+static zlong cachehashgen = -1;
+
+/*
+ * The value of $ZCOMPILE_CACHE when we found we couldn't write below
+ * it; we only read the cache until the value changes.
+ */
+
+static char *cache_readonly;
+
+/**/
+static void
+cache_hash_reswd(HashNode hn, UNUSED(int flags))
+{
+    cachehash += hasher(hn->nam);
+}
+
+/**/
+static void
+cache_hash_alias(HashNode hn, int flags)
+{
+    Alias a = (Alias) hn;
+
+    cachehash += ((hasher(a->node.nam) * 31 + hasher(a->text)) ^
+		  (a->node.flags + flags));
+}
+
+/**/
+static unsigned int
+cache_hash(void)
+{
+    unsigned int h;
+    int i;
+
+    if (cachehashgen != lexgen) {
+	cachehash = 0;
+	scanhashtable(reswdtab, 0, DISABLED, 0, cache_hash_reswd, 0);
+	reswdhash = cachehash;
+	cachehash = 0;
+	scanhashtable(aliastab, 0, 0, DISABLED, cache_hash_alias, 0);
+	scanhashtable(sufaliastab, 0, 0, DISABLED, cache_hash_alias, 1);
+	aliashash = cachehash;
+	cachehashgen = lexgen;
+    }
+    for (h = 0, i = 0; i < OPT_SIZE; i++)
+	h = (h << 5) + h + (unsigned char) opts[i];
+    h += reswdhash;
+    if (!noaliases && isset(ALIASESOPT))
+	h += aliashash;
+    return h;
+}
+
+/* Is the cache file younger than the last change to the file? */
+
+/**/
+static int
+cache_fresh(struct stat *stc, struct stat *stn)
+{
+    if (stc->st_mtime != stn->st_ctime)
+	return stc->st_mtime > stn->st_ctime;
+#if defined(GET_ST_MTIME_NSEC) && defined(GET_ST_CTIME_NSEC)
+    return GET_ST_MTIME_NSEC(*stc) > GET_ST_CTIME_NSEC(*stn);
+#else
+    return 0;
+#endif
+}
+
+/* Get the name of the cache file for `file' (unmetafied) in `dir'. */
+
+/**/
+static char *
+cache_file_name(char *dir, char *file)
+{
+    char *cwd, *ret;
+
+    cwd = (*file == '/') ? "" : unmeta(pwd);
+    ret = (char *) zhalloc(strlen(dir) + strlen(cwd) + strlen(file) +
+			   sizeof(FD_EXT) + 12);
+    sprintf(ret, "%s%s%s%s-%08x%s", dir, cwd, (*file == '/') ? "" : "/",
+	    file, cache_hash(), FD_EXT);
+    return ret;
+}
+
+/*
+ * Compile `file' into `cache', creating directories as needed.
+ * Returns 1 if that failed, 2 if it's because we can't write there.
+ */
+
+/**/
+static int
+write_cache_file(char *file, char *cache)
+{
+    char *files[2], *tmp, *p;
+    int ret, ne = noerrs;
+
+    for (p = strchr(cache + 1, '/'); p; p = strchr(p + 1, '/')) {
+	*p = '\0';
+	ret = (mkdir(cache, 0700) && errno != EEXIST);
+	if (!ret && !strchr(p + 1, '/'))
+	    ret = access(cache, W_OK);
+	*p = '/';
+	if (ret)
+	    return 2;
+    }
+    tmp = (char *) zhalloc(strlen(cache) + 24);
+    sprintf(tmp, "%s.%ld%s", cache, (long) getpid(), FD_EXT);
+
+    files[0] = file;
+    files[1] = NULL;
+    noerrs = 1;
+    /*
+     * Each file has a cache of its own, so a mapped one would keep a
+     * descriptor and a mapping for every function autoloaded.
+     */
+    ret = build_dump(NULL, tmp, files, noaliases, 0, 0);
+    noerrs = ne;
+    errflag &= ~ERRFLAG_ERROR;
+    if (ret || rename(tmp, cache)) {
+	unlink(tmp);
+	return 1;
+    }
+    return 0;
+}
+
+/*
+ * Look for the compiled copy of the autoload file `file' in the cache
+ * directory, and write it if it isn't there or is out of date.
+ * Returns the code for `name' in it, or NULL if the cache isn't in use
+ * or can't be used.
+ */
+
+/**/
+Eprog
+try_cache_file(char *file, char *name, int *ksh)
+{
+    char *dir, *cache;
+    struct stat stc, stn;
+    Eprog prog = NULL;
+    int ret;
+
+    if (!(dir = getsparam("ZCOMPILE_CACHE")) || !*dir ||
+	stat(file, &stn) || !S_ISREG(stn.st_mode))
+	return NULL;
+    cache = cache_file_name(dupstring(unmeta(dir)), file);
+
+    queue_signals();
+    if (!stat(cache, &stc) && cache_fresh(&stc, &stn))
+	prog = check_dump_file(cache, &stc, name, ksh, 0);
+    if (!prog && !(cache_readonly && !strcmp(cache_readonly, dir))) {
+	if (!(ret = write_cache_file(file, cache))) {
+	    if (!stat(cache, &stc) && cache_fresh(&stc, &stn))
+		prog = check_dump_file(cache, &stc, name, ksh, 0);
+	} else if (ret == 2) {
+	    zsfree(cache_readonly);
+	    cache_readonly = ztrdup(dir);
+	}
+    }
+    unqueue_signals();
+
+    return prog;
+}
+
 /* See if `file' names a wordcode dump file and that contains the
  * definition for the function `name'. If so, return an eprog for it. */
 
@@ -3862,6 +4186,15 @@ check_dump_file(char *file, struct stat *sbuf, char *name, int *ksh,
 	    return prog;
 	}
     }
+#ifdef USE_MMAP
+    else if (!f && (fdflags(d) & FDF_MAP)) {
+	/*
+	 * Map the file now, so that looking for other functions in
+	 * it doesn't mean reading the header again.
+	 */
+	load_dump_file(file, sbuf, (fdflags(d) & FDF_OTHER), fdother(d));
+    }
+#endif
     return NULL;
 }
 
@@ -690,16 +690,19 @@ patcompile(char *exp, int inflags, char **endexp)
 		/* patmlen is really strlen.  We don't need a null. */
 		p->patmlen = p->size - startoff;
 	    } else {
-		/* starting point info */
-		if (P_OP(pscan) == P_EXACTLY && !p->globflags &&
-		    P_LS_LEN(pscan))
+		/*
+		 * starting point info; literals are compared bytewise
+		 * whether or not they contain multibyte characters
+		 */
+		if (P_OP(pscan) == P_EXACTLY &&
+		    !(p->globflags & ~GF_MULTIBYTE) && P_LS_LEN(pscan))
 		    p->patstartch = *P_LS_STR(pscan);
 		/*
 		 * Find the longest literal string in something expensive.
 		 * This is itself not all that cheap if we have
 		 * case-insensitive matching or approximation, so don't.
 		 */
-		if ((flags & P_HSTART) && !p->globflags) {
+		if ((flags & P_HSTART) && !(p->globflags & ~GF_MULTIBYTE)) {
 		    lng = NULL;
 		    len = 0;
 		    for (; pscan; pscan = PATNEXT(pscan))
@@ -2421,9 +2424,14 @@ pattryrefs(Patprog prog, char *string, int stringlen, int unmetalenin,
     } else {
 	/*
 	 * Test for a `must match' string, unless we're scanning for a match
-	 * in which case we don't need to do this each time.
+	 * in which case we don't need to do this each time.  Before
+	 * that, a match starting with a literal needs the same first
+	 * byte, which is cheap enough to test even when scanning.
 	 */
 	ret = 1;
+	if (prog->patstartch &&
+	    (patinstart == patinend || *patinstart != prog->patstartch))
+	    return 0;
 	if (!(prog->flags & PAT_SCAN) && prog->mustoff)
 	{
 	    char *testptr;	/* start pointer into test string */
@@ -2614,6 +2622,36 @@ pattryrefs(Patprog prog, char *string, int stringlen, int unmetalenin,
  * Unusual and futile attempt at modular encapsulation.
  */
 
+/*
+ * Return the literal text that starts every string the pattern can
+ * match, metafied and on the heap, and set *lenp to its length.
+ * Set *wholep if the pattern is that text and nothing else.  Return
+ * NULL if the pattern doesn't start with a literal we can use.
+ */
+
+/**/
+mod_export char *
+patliteralprefix(Patprog prog, int *lenp, int *wholep)
+{
+    Upat pscan;
+    char *str;
+
+    if (prog->flags & PAT_PURES) {
+	*wholep = 1;
+	*lenp = (int)prog->patmlen;
+	return dupstrpfx((char *)prog + prog->startoff, *lenp);
+    }
+    *wholep = 0;
+    if (!prog->patstartch)
+	return NULL;
+    /* patcompile() found this at the start of the only branch */
+    pscan = P_OPERAND((Upat)((char *)prog + prog->startoff));
+    DPUTS(P_OP(pscan) != P_EXACTLY, "BUG: start character without literal");
+    str = metafy(P_LS_STR(pscan), P_LS_LEN(pscan), META_HEAPDUP);
+    *lenp = strlen(str);
+    return str;
+}
+
 /**/
 int
 patmatchlen(void)
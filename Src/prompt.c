@@ -818,46 +818,29 @@ putpromptchar(int doprint, int endchar, unsigned int *txtchangep)
 		break;
 	    }
 	    case 'I':
-		if (funcstack && funcstack->tp != FS_SOURCE &&
-		    !IN_EVAL_TRAP()) {
-		    /*
-		     * We're in a function or an eval with
-		     * EVALLINENO.  Calculate the line number in
-		     * the file.
-		     */
-		    zlong flineno = lineno + funcstack->flineno;
-		    /* take account of eval line nos. starting at 1 */
-		    if (funcstack->tp == FS_EVAL)
-			lineno--;
+	    case 'i':
+		{
+		    /* %I is the line in the file, as shown by zsh/zcover */
+		    zlong line = lineno;
+
+		    if (*bv->fm == 'I')
+			(void)execfileline(&line);
 		    addbufspc(DIGBUFSIZE);
 #if defined(ZLONG_IS_LONG_LONG) && defined(PRINTF_HAS_LLD)
-		    sprintf(bv->bp, "%lld", flineno);
+		    sprintf(bv->bp, "%lld", line);
 #else
-		    sprintf(bv->bp, "%ld", (long)flineno);
+		    sprintf(bv->bp, "%ld", (long)line);
 #endif
 		    bv->bp += strlen(bv->bp);
 		    break;
 		}
-		/* else we're in a file and lineno is already correct */
-		/* FALLTHROUGH */
-	    case 'i':
-		addbufspc(DIGBUFSIZE);
-#if defined(ZLONG_IS_LONG_LONG) && defined(PRINTF_HAS_LLD)
-		sprintf(bv->bp, "%lld", lineno);
-#else
-		sprintf(bv->bp, "%ld", (long)lineno);
-#endif
-		bv->bp += strlen(bv->bp);
-		break;
 	    case 'x':
-		if (funcstack && funcstack->tp != FS_SOURCE &&
-		    !IN_EVAL_TRAP())
-		    promptpath(funcstack->filename ? funcstack->filename : "",
-			       arg, 0);
-		else
-		    promptpath(scriptfilename ? scriptfilename : argzero,
-			       arg, 0);
-		break;
+		{
+		    zlong line;
+
+		    promptpath(execfileline(&line), arg, 0);
+		    break;
+		}
 	    case '\0':
 		return 0;
 	    case Meta:
@@ -420,6 +420,15 @@ signal_suspend(UNUSED(int sig), int wait_cmd)
 /**/
 int last_signal;
 
+/*
+ * Write end of a pipe to poke when a child is reaped, so that a
+ * poll() on the other end returns; -1 if none.  Used by zle to run
+ * handlers for children, see addzlechild().
+ */
+
+/**/
+mod_export int chldwakefd = -1;
+
 /*
  * Wait for any processes that have changed state.
  *
@@ -565,6 +574,12 @@ wait_for_processes(void)
 		    WEXITSTATUS(status)));
 	    addbgstatus(pid, val);
 	}
+	/*
+	 * Wake up an event loop waiting for children.  The pipe
+	 * doesn't block; if it's full a wakeup is pending anyway.
+	 */
+	if (chldwakefd >= 0 && write(chldwakefd, "", 1) < 0)
+	    errno = old_errno;
 
 	unqueue_signals();
     }
@@ -114,7 +114,11 @@ eltpcmp(const void *a, const void *b)
 	as += (laststarta - as);
     }
 #ifdef HAVE_STRCOLL
-    cmp = strcoll(as, bs);
+    /* Keys are only made if there are no embedded nulls */
+    if (ae->key && be->key)
+	cmp = strcmp(ae->key, be->key);
+    else
+	cmp = strcoll(as, bs);
 #endif
     if (sortnumeric) {
 	for (; *as == *bs && *as; as++, bs++);
@@ -168,6 +172,7 @@ zstrcmp(const char *as, const char *bs, int sortflags)
     be.cmp = bs;
     ae.len = -1;
     be.len = -1;
+    ae.key = be.key = NULL;
 
     aeptr = &ae;
     beptr = &be;
@@ -185,6 +190,62 @@ zstrcmp(const char *as, const char *bs, int sortflags)
 }
 
 
+/*
+ * Sort the n elements of elts, using tmp, with room for half as many,
+ * as workspace.  This is a merge sort, so elements that compare equal
+ * stay in the order they started in, which qsort() doesn't promise.
+ */
+
+/**/
+static void
+eltmsort(SortElt *elts, SortElt *tmp, int n)
+{
+    int h = n / 2, i, j, k;
+
+    if (n < 8) {
+	/* insertion sort for short runs */
+	for (i = 1; i < n; i++) {
+	    SortElt e = elts[i];
+
+	    for (j = i; j > 0 && eltpcmp(&elts[j-1], &e) > 0; j--)
+		elts[j] = elts[j-1];
+	    elts[j] = e;
+	}
+	return;
+    }
+    eltmsort(elts, tmp, h);
+    eltmsort(elts + h, tmp, n - h);
+    if (eltpcmp(&elts[h-1], &elts[h]) <= 0)
+	return;
+    memcpy(tmp, elts, h * sizeof(SortElt));
+    for (i = 0, j = h, k = 0; i < h && j < n; )
+	elts[k++] = (eltpcmp(&elts[j], &tmp[i]) < 0) ? elts[j++] : tmp[i++];
+    while (i < h)
+	elts[k++] = tmp[i++];
+}
+
+/**/
+#ifdef HAVE_STRCOLL
+
+/* Make the collation key for a string with strxfrm(), on the heap. */
+
+/**/
+static char *
+eltkey(const char *s)
+{
+    size_t size = 4 * strlen(s) + 16, ret;
+    char *key = zhalloc(size);
+
+    if ((ret = strxfrm(key, s, size)) >= size) {
+	key = zhalloc(ret + 1);
+	strxfrm(key, s, ret + 1);
+    }
+    return key;
+}
+
+/**/
+#endif
+
 /*
  * Sort an array of metafied strings.  Use an "or" of bit flags
  * to decide how to sort.  See the SORTIT_* flags in zsh.h.
@@ -207,7 +268,7 @@ strmetasort(char **array, int sortwhat, int *unmetalenp)
      */
     SortElt *sortptrarr, *sortptrarrptr;
     SortElt sortarr, sortarrptr;
-    int oldsortdir, oldsortnumeric, nsort;
+    int oldsortdir, oldsortnumeric, nsort, usekeys = 0;
 
     nsort = arrlen(array);
     if (nsort < 2)
@@ -215,6 +276,25 @@ strmetasort(char **array, int sortwhat, int *unmetalenp)
 
     pushheap();
 
+#if defined(HAVE_STRCOLL) && defined(USE_LOCALE)
+    /*
+     * Unless the collation is plain byte order, work it out once for
+     * each string rather than in every comparison.  Byte order is
+     * used by the C locale and by some others, such as C.UTF-8; in
+     * those strxfrm() leaves strings unchanged.
+     */
+    {
+	char *coll = setlocale(LC_COLLATE, NULL);
+
+	if (coll && strcmp(coll, "C") && strcmp(coll, "POSIX")) {
+	    char key[64];
+
+	    usekeys = strxfrm(key, "aA_0-\303\251", sizeof(key)) >=
+		sizeof(key) || strcmp(key, "aA_0-\303\251");
+	}
+    }
+#endif
+
     sortptrarr = (SortElt *) zhalloc(nsort * sizeof(SortElt));
     sortarr = (SortElt) zhalloc(nsort * sizeof(struct sortelt));
     for (arrptr = array, sortptrarrptr = sortptrarr, sortarrptr = sortarr;
@@ -358,6 +438,12 @@ strmetasort(char **array, int sortwhat, int *unmetalenp)
 	    sortarrptr->cmp = *arrptr;
 	    sortarrptr->len = needlen ? unmetalenp[arrptr-array] : -1;
 	}
+#ifdef HAVE_STRCOLL
+	sortarrptr->key = (usekeys && sortarrptr->len == -1) ?
+	    eltkey(sortarrptr->cmp) : NULL;
+#else
+	sortarrptr->key = NULL;
+#endif
     }
     /*
      * We probably don't need to restore the following, but it's pretty cheap.
@@ -368,7 +454,8 @@ strmetasort(char **array, int sortwhat, int *unmetalenp)
     sortdir = (sortwhat & SORTIT_BACKWARDS) ? -1 : 1;
     sortnumeric = (sortwhat & SORTIT_NUMERICALLY) ? 1 : 0;
 
-    qsort(sortptrarr, nsort, sizeof(SortElt), eltpcmp);
+    eltmsort(sortptrarr, (SortElt *) zhalloc((nsort / 2 + 1) * sizeof(SortElt)),
+	     nsort);
 
     sortnumeric = oldsortnumeric;
     sortdir = oldsortdir;
@@ -2998,8 +2998,10 @@ paramsubst(LinkList l, LinkNode n, char **str, int qt, int pf_flags,
 		    *p++ = NULL;
 		    if (arrasg > 1) {
 			Param pm = sethparam(idbeg, a);
+			/* These are the parameter's own strings */
 			if (pm)
-			    aval = paramvalarr(pm->gsu.h->getfn(pm), hkeys|hvals);
+			    aval = arrdup(paramvalarr(pm->gsu.h->getfn(pm),
+						      hkeys|hvals));
 		    } else
 			setaparam(idbeg, a);
 		    isarr = 1;
@@ -3110,16 +3112,26 @@ paramsubst(LinkList l, LinkNode n, char **str, int qt, int pf_flags,
 	     * Either loop over an array doing replacements or
 	     * do the replacment on a string.
 	     *
-	     * We need an untokenized value for matching.
+	     * We need an untokenized value for matching.  The matcher
+	     * doesn't alter the elements and puts its results in a new
+	     * array, so there's no need to copy an array without tokens;
+	     * elements that are passed through unchanged are still shared
+	     * with the original, so it stays not copied.
 	     */
 	    if (!vunset && isarr) {
 		char **ap;
 		if (!copied) {
-		    aval = arrdup(aval);
-		    copied = 1;
+		    for (ap = aval; *ap && !has_token(*ap); ap++)
+			;
+		    if (*ap) {
+			aval = arrdup(aval);
+			copied = 1;
+		    }
 		}
-		for (ap = aval; *ap; ap++) {
-		    untokenize(*ap);
+		if (copied) {
+		    for (ap = aval; *ap; ap++) {
+			untokenize(*ap);
+		    }
 		}
 		getmatcharr(&aval, s, flags, flnum, replstr);
 	    } else {
@@ -3184,8 +3196,9 @@ paramsubst(LinkList l, LinkNode n, char **str, int qt, int pf_flags,
 		} else {
 		    out = zhalloc(sizeof(char *) * (2 * outlen + 1));
 		    while (i < outlen) {
-			if (copied)
-			    out[i*2] = aval[i % alen];
+			/* Elements used again must be copies, not the same string */
+			if (copied && i < alen)
+			    out[i*2] = aval[i];
 			else
 			    out[i*2] = dupstring(aval[i % alen]);
 			out[i*2+1] = dupstring(zip[i % ziplen]);
@@ -3374,8 +3387,9 @@ paramsubst(LinkList l, LinkNode n, char **str, int qt, int pf_flags,
 			*dstptr++ = dupstring(argzero);
 			count--;
 		    }
+		    /* The strings are copied later if need be */
 		    while (count--)
-			*dstptr++ = dupstring(*srcptr++);
+			*dstptr++ = *srcptr++;
 		    *dstptr = (char *)NULL;
 		    aval = newarr;
 		} else {
@@ -3916,8 +3930,9 @@ paramsubst(LinkList l, LinkNode n, char **str, int qt, int pf_flags,
 
 	/* Handle the (u) flag; we need this before the next test */
 	if (unique) {
+	    /* Only the elements move, the strings needn't be copied */
 	    if(!copied)
-		aval = arrdup(aval);
+		aval = arrshare(aval);
 
 	    i = arrlen(aval);
 	    if (i > 1)
@@ -3954,7 +3969,7 @@ paramsubst(LinkList l, LinkNode n, char **str, int qt, int pf_flags,
 	/* Handle (o) and (O) and their variants */
 	if (sortit != SORTIT_ANYOLDHOW) {
 	    if (!copied)
-		aval = arrdup(aval);
+		aval = arrshare(aval);
 	    if (indord) {
 		if (sortit & SORTIT_BACKWARDS) {
 		    char *copy;
@@ -4069,7 +4084,8 @@ paramsubst(LinkList l, LinkNode n, char **str, int qt, int pf_flags,
 		if (qt && !*x && isarr != 2)
 		    y = dupstring(nulstring);
 		else {
-		    y = dupstring(x);
+		    /* Copy the value if it's still the parameter's */
+		    y = copied ? x : dupstring(x);
 		    if (globsubst)
 			shtokenize(y);
 		}
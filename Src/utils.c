@@ -386,6 +386,12 @@ putraw(int c)
     return 0;
 }
 
+/* Number of bytes output to the terminal through putshout() and *
+ * the line editor's display routines, for measuring redisplay.  */
+
+/**/
+mod_export zlong shoutbytes;
+
 /* Output a single character, for the termcap routines. */
 
 /**/
@@ -393,6 +399,7 @@ mod_export int
 putshout(int c)
 {
     putc(c, shout);
+    shoutbytes++;
     return 0;
 }
 
@@ -3013,6 +3020,7 @@ spckword(char **s, int hist, int cmd, int ask)
 	    return;
 	ic = String;
 	d = 100;
+	importallenv();
 	scanhashtable(paramtab, 1, 0, 0, spscan, 0);
     } else if (**s == Equals) {
 	if (*t)
@@ -3491,6 +3499,119 @@ skipwsep(char **s)
     return i;
 }
 
+/*
+ * Check if separators can be found in a metafied string by looking at
+ * single bytes: sep is the separator string, or NULL for the characters
+ * in IFS.  That's not so in a multibyte character set other than UTF-8,
+ * where a byte in the middle of a character can look like an ASCII
+ * character, nor for non-ASCII characters in IFS, which aren't in
+ * typtab.  In UTF-8, a separator made of whole characters can only match
+ * a string at the start of a character or, when metafied, after a Meta,
+ * which we check for.
+ */
+
+/**/
+static int
+bytesep(char *sep)
+{
+#ifdef MULTIBYTE_SUPPORT
+    if (isset(MULTIBYTE)) {
+	char *s;
+
+# if defined(HAVE_NL_LANGINFO) && defined(CODESET)
+	if (MB_CUR_MAX > 1 && strcmp(nl_langinfo(CODESET), "UTF-8"))
+	    return 0;
+# else
+	if (MB_CUR_MAX > 1)
+	    return 0;
+# endif
+	if (!sep && ifs) {
+	    for (s = ifs; *s; s++)
+		if (STOUC(*s == Meta ? *++s ^ 32 : *s) > 0x7f)
+		    return 0;
+	} else if (sep && MB_CUR_MAX > 1) {
+	    /*
+	     * Otherwise a separator that is only part of a character,
+	     * such as a byte given as \x.., could match inside one.
+	     */
+	    mbstate_t mbs;
+	    wchar_t wc;
+	    size_t cnt;
+	    int len;
+
+	    s = dupstring(sep);
+	    unmetafy(s, &len);
+	    memset(&mbs, 0, sizeof(mbs));
+	    while (len > 0) {
+		cnt = mbrtowc(&wc, s, len, &mbs);
+		if (cnt == MB_INVALID || cnt == MB_INCOMPLETE || !cnt)
+		    return 0;
+		s += cnt;
+		len -= cnt;
+	    }
+	}
+    }
+#endif
+    return 1;
+}
+
+/* Test if the (possibly metafied) character at s is in IFS. */
+
+#define ifsbyte(s) isep(*(s) == Meta ? (s)[1] ^ 32 : *(s))
+
+/*
+ * Return the end of the IFS character at s, or s if there isn't one.
+ * If bytes is set, bytesep(NULL) said we can do this a byte at a time.
+ */
+
+/**/
+static char *
+ifsend(char *s, int bytes)
+{
+    if (bytes)
+	return (*s && ifsbyte(s)) ? s + 1 + (*s == Meta) : s;
+    return itype_end(s, ISEP, 1);
+}
+
+/* Find the next IFS character in s, if bytesep(NULL) says we can. */
+
+/**/
+static char *
+findifs(char *s)
+{
+    while (*s && !ifsbyte(s))
+	s += 1 + (*s == Meta);
+    return s;
+}
+
+/*
+ * As findsep() for a non-empty separator, when bytesep(sep) says we
+ * can search bytes; strstr() and strchr() are much faster than
+ * checking each character in turn.
+ */
+
+/**/
+static int
+findsepbytes(char **s, char *sep)
+{
+    char *t = *s;
+    int i;
+
+    for (;;) {
+	if (!(t = sep[1] ? strstr(t, sep) : strchr(t, *sep))) {
+	    *s += strlen(*s);
+	    return -1;
+	}
+	/* Not the second half of a metafied character */
+	if (t == *s || t[-1] != Meta)
+	    break;
+	t++;
+    }
+    i = (t > *s);
+    *s = t;
+    return i;
+}
+
 /*
  * haven't worked out what allownull does; it's passed down from
  *   sepsplit but all the cases it's used are either 0 or 1 without
@@ -3499,14 +3620,18 @@ skipwsep(char **s)
  *   allownull's value is associated with whether we are using
  *   metafied strings.
  * see findsep() below for handling of `quote' argument
+ *
+ * On the heap, the words share a single copy of the string,
+ * terminated where each separator was.
  */
 
 /**/
 mod_export char **
 spacesplit(char *s, int allownull, int heap, int quote)
 {
-    char *t, **ret, **ptr;
+    char *t, **ret, **ptr, *buf = NULL, *start;
     int l = sizeof(*ret) * (wordcount(s, NULL, -!allownull) + 1);
+    int bytes = !quote && bytesep(NULL);
     char *(*dup)(const char *) = (heap ? dupstring : ztrdup);
 
     /* ### TODO: s/calloc/alloc/ */
@@ -3518,17 +3643,18 @@ spacesplit(char *s, int allownull, int heap, int quote)
 	 * so make sure it's hackable.
 	 */
 	s = dupstring(s);
-    }
+    } else if (heap)
+	buf = dupstring(s);
 
-    t = s;
+    t = start = s;
     skipwsep(&s);
     MB_METACHARINIT();
-    if (*s && itype_end(s, ISEP, 1) != s)
+    if (*s && ifsend(s, bytes) != s)
 	*ptr++ = dup(allownull ? "" : nulstring);
     else if (!allownull && t != s)
 	*ptr++ = dup("");
     while (*s) {
-	char *iend = itype_end(s, ISEP, 1);
+	char *iend = ifsend(s, bytes);
 	if (iend != s) {
 	    s = iend;
 	    skipwsep(&s);
@@ -3538,8 +3664,14 @@ spacesplit(char *s, int allownull, int heap, int quote)
 	    skipwsep(&s);
 	}
 	t = s;
-	(void)findsep(&s, NULL, quote);
-	if (s > t || allownull) {
+	if (bytes)
+	    s = findifs(s);
+	else
+	    (void)findsep(&s, NULL, quote);
+	if (buf && s > t) {
+	    *ptr++ = buf + (t - start);
+	    buf[s - start] = '\0';
+	} else if (s > t || allownull) {
 	    *ptr = (char *) (heap ? zhalloc((s - t) + 1) :
 		                     zalloc((s - t) + 1));
 	    ztrncpy(*ptr++, t, s - t);
@@ -3673,31 +3805,37 @@ findword(char **s, char *sep)
 int
 wordcount(char *s, char *sep, int mul)
 {
-    int r, sl, c;
+    int r, sl, c, bytes;
 
     if (sep) {
 	r = 1;
 	sl = strlen(sep);
-	for (; (c = findsep(&s, sep, 0)) >= 0; s += sl)
+	bytes = sl && bytesep(sep);
+	for (; (c = bytes ? findsepbytes(&s, sep) :
+		findsep(&s, sep, 0)) >= 0; s += sl)
 	    if ((c || mul) && (sl || *(s + sl)))
 		r++;
     } else {
 	char *t = s;
 
 	r = 0;
+	bytes = bytesep(NULL);
 	if (mul <= 0)
 	    skipwsep(&s);
-	if ((*s && itype_end(s, ISEP, 1) != s) ||
+	if ((*s && ifsend(s, bytes) != s) ||
 	    (mul < 0 && t != s))
 	    r++;
 	for (; *s; r++) {
-	    char *ie = itype_end(s, ISEP, 1);
+	    char *ie = ifsend(s, bytes);
 	    if (ie != s) {
 		s = ie;
 		if (mul <= 0)
 		    skipwsep(&s);
 	    }
-	    (void)findsep(&s, NULL, 0);
+	    if (bytes)
+		s = findifs(s);
+	    else
+		(void)findsep(&s, NULL, 0);
 	    t = s;
 	    if (mul <= 0)
 		skipwsep(&s);
@@ -3734,9 +3872,13 @@ sepjoin(char **s, char *sep, int heap)
     r = p = (char *) (heap ? zhalloc(l) : zalloc(l));
     t = s;
     while (*t) {
-	strucpy(&p, *t);
-	if (*++t)
-	    strucpy(&p, sep);
+	l = strlen(*t);
+	memcpy(p, *t, l);
+	p += l;
+	if (*++t) {
+	    memcpy(p, sep, sl);
+	    p += sl;
+	}
     }
     *p = '\0';
     return r;
@@ -3746,8 +3888,8 @@ sepjoin(char **s, char *sep, int heap)
 char **
 sepsplit(char *s, char *sep, int allownull, int heap)
 {
-    int n, sl;
-    char *t, *tt, **r, **p;
+    int n, sl, bytes;
+    char *t, *tt, **r, **p, *buf = NULL;
 
     /* Null string?  Treat as empty string. */
     if (s[0] == Nularg && !s[1])
@@ -3760,14 +3902,26 @@ sepsplit(char *s, char *sep, int allownull, int heap)
     n = wordcount(s, sep, 1);
     r = p = (char **) (heap ? zhalloc((n + 1) * sizeof(char *)) :
 	                       zalloc((n + 1) * sizeof(char *)));
+    bytes = sl && bytesep(sep);
+    /* As in spacesplit(), words on the heap share a copy of s */
+    if (heap && sl)
+	buf = dupstring(s);
 
     for (t = s; n--;) {
 	tt = t;
-	(void)findsep(&t, sep, 0);
-	*p = (char *) (heap ? zhalloc(t - tt + 1) :
-	                       zalloc(t - tt + 1));
-	strncpy(*p, tt, t - tt);
-	(*p)[t - tt] = '\0';
+	if (bytes)
+	    (void)findsepbytes(&t, sep);
+	else
+	    (void)findsep(&t, sep, 0);
+	if (buf) {
+	    *p = buf + (tt - s);
+	    buf[t - s] = '\0';
+	} else {
+	    *p = (char *) (heap ? zhalloc(t - tt + 1) :
+			   zalloc(t - tt + 1));
+	    strncpy(*p, tt, t - tt);
+	    (*p)[t - tt] = '\0';
+	}
 	p++;
 	t += sl;
     }
@@ -4284,6 +4438,38 @@ arrdup_max(char **s, unsigned max)
     return y;
 }
 
+/*
+ * Copy the array s to the heap without duplicating the strings, which
+ * are shared with the original.  That's enough when only the order or
+ * number of elements is going to change; the strings must be copied
+ * before they are modified.
+ */
+
+/**/
+mod_export char **
+arrshare(char **s)
+{
+    return arrshare_max(s, arrlen(s));
+}
+
+/* As arrshare(), but copy at most max elements */
+
+/**/
+mod_export char **
+arrshare_max(char **s, unsigned max)
+{
+    char **x, **y;
+    unsigned len;
+
+    for (len = 0; len < max && s[len]; len++)
+	;
+    y = x = (char **) zhalloc(sizeof(char *) * (len + 1));
+    memcpy(x, s, len * sizeof(char *));
+    x[len] = NULL;
+
+    return y;
+}
+
 /**/
 mod_export char **
 zarrdup(char **s)
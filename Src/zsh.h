@@ -816,6 +816,7 @@ struct eprog {
 #define EF_HEAP 2
 #define EF_MAP  4
 #define EF_RUN  8
+#define EF_COVER 16		/* lines found by zsh/zcover */
 
 typedef struct estate *Estate;
 
@@ -2473,6 +2474,7 @@ enum {
     SINGLECOMMAND,
     SINGLELINEZLE,
     SOURCETRACE,
+    STARTUPTIMES,
     SUNKEYBOARDHACK,
     TRANSIENTRPROMPT,
     TRAPSASYNC,
@@ -2949,13 +2951,19 @@ enum {
 };
 
 /*
- * Element of array passed to qsort().
+ * Element of array sorted by strmetasort().
  */
 struct sortelt {
     /* The original string. */
     char *orig;
     /* The string used for comparison. */
     const char *cmp;
+    /*
+     * The collation key for cmp from strxfrm(), or NULL.  Comparing
+     * keys with strcmp() gives the same result as strcoll() on the
+     * strings, without the cost of working the collation out again.
+     */
+    const char *key;
     /*
      * The length of the string if passed down to the sort algorithm.
      * Used to sort the lengths together with the strings.
@@ -2970,6 +2978,44 @@ struct sortelt {
 
 typedef struct sortelt *SortElt;
 
+/*
+ * A range in braces, {n1..n2[..incr]} or {c1..c2}: count values
+ * starting at first and going up by incr, which may be negative.
+ */
+struct bracerange {
+    zlong first;
+    zlong incr;
+    zlong count;
+    /* Width to pad numbers to with zeroes */
+    int minw;
+    /* Set if the values are characters rather than numbers */
+    int chars;
+};
+
+typedef struct bracerange *Bracerange;
+
+/*
+ * The words of a for loop's list that consist only of text and brace
+ * ranges, produced one at a time by rangeiternext() rather than all
+ * expanded at once.  Each word is lits[0], a value from ranges[0],
+ * lits[1], ... lits[nranges].
+ */
+struct rangeword {
+    int nranges;
+    char **lits;
+    struct bracerange *ranges;
+};
+
+struct rangeiter {
+    int nwords;
+    /* The word being produced, and the index into each of its ranges */
+    int word;
+    struct rangeword *words;
+    zlong *idx;
+};
+
+typedef struct rangeiter *Rangeiter;
+
 /*********************************************************/
 /* Structures to save and restore for individual modules */
 /*********************************************************/